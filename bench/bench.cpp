@@ -0,0 +1,886 @@
+// Microbenchmarks for the headless core.
+// Usage: Bench [filter], runs the benchmarks whose name contains filter
+#include <core.h>
+#include <ui.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+
+using namespace core;
+
+static const char* filter = nullptr;
+
+static
+bool Selected(const char* name) {
+  return !filter || strstr(name, filter);
+}
+
+// Average nanoseconds per call of fn, over iters calls after a warm-up
+template <typename F>
+f64 NsPerIter(usize iters, F&& fn) {
+  for (usize i = 0; i < Max<usize>(iters / 10, 1); ++i) {
+    fn();
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (usize i = 0; i < iters; ++i) {
+    fn();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<f64, std::nano>(elapsed).count() / iters;
+}
+
+static
+void Report(const char* name, const char* variant, f64 value, const char* unit) {
+  printf("%-24s %-28s %12.1f %s\n", name, variant, value, unit);
+}
+
+// A frame with num_windows windows, each with a header and a few buttons
+static
+void BuildWindows(ui::Ui* ui, usize num_windows) {
+  for (usize i = 0; i < num_windows; ++i) {
+    ui::PushId(ui, i);
+    ui::Window(ui, LIT("Window"));
+    ui::Header(ui, LIT("Header"));
+    ui::HList(ui);
+    ui::Button(ui, LIT("Ok"));
+    ui::Button(ui, LIT("Cancel"));
+    ui::PopParent(ui);
+    ui::PopParent(ui);
+    ui::PopId(ui);
+  }
+}
+
+static
+void RunFrame(ui::UiCtx* ctx, Arena* frame_arena, usize num_windows) {
+  auto ui = ui::BeginUi(ctx, frame_arena, { 0.0, 0.0, 1600.0, 900.0 });
+  BuildWindows(ui, num_windows);
+  ui::EndUi(ui);
+}
+
+// Reset used to memset every chunk in full, each frame
+static
+void BenchArenaZeroing() {
+  const char* name = "arena_zeroing";
+  if (!Selected(name)) { return; }
+
+  for (bool zero : { false, true }) {
+    auto ctx = ui::NewCtx();
+    Arena frame_arena = NewArena(4 * 1024 * 1024);
+    auto ns = NsPerIter(500, [&]() {
+      RunFrame(&ctx, &frame_arena, 100);
+      Reset(&frame_arena);
+      if (zero) {
+        for (auto chunk = frame_arena.first; chunk; chunk = chunk->next) {
+          memset(chunk->buffer, 0, chunk->capacity);
+        }
+      }
+    });
+    Report(name, zero ? "zero on reset" : "rewind only", ns, "ns/frame");
+    Free(&frame_arena);
+    ui::Destroy(&ctx);
+  }
+}
+
+// Every window is draggable, so each one has a widget cache entry
+static
+void BenchWidgetCache() {
+  const char* name = "widget_cache";
+  if (!Selected(name)) { return; }
+
+  for (usize num_windows : { 100, 1000, 10000 }) {
+    auto ctx = ui::NewCtx();
+    Arena frame_arena = NewVirtualArena(256 * 1024 * 1024);
+    auto ns = NsPerIter(10000000 / (num_windows * 10), [&]() {
+      RunFrame(&ctx, &frame_arena, num_windows);
+      Reset(&frame_arena);
+    });
+    char variant[32];
+    snprintf(variant, sizeof(variant), "%zu windows", num_windows);
+    Report(name, variant, ns / num_windows, "ns/window/frame");
+    Free(&frame_arena);
+    ui::Destroy(&ctx);
+  }
+}
+
+// The hash before wyhash, for comparison
+static
+u64 OldHash(u64 x, u64 y) {
+  return x * 13 + y * 17;
+}
+
+static
+u64 OldHash(String8 str) {
+  u64 accum = 0;
+  for (usize i = 0; i < str.len; ++i) {
+    accum = OldHash(accum, str.ptr[i]);
+  }
+  return accum;
+}
+
+static
+String8 Format(Arena* arena, const char* format, usize a, usize b = 0) {
+  char buffer[64];
+  auto len = snprintf(buffer, sizeof(buffer), format, a, b);
+  auto ptr = (char*)AllocBytes(arena, len);
+  memcpy(ptr, buffer, len);
+  return { .ptr = ptr, .len = (usize)len };
+}
+
+// Labels as a ui builds them: numbered items, "##" suffixes, short
+// codes, and short words in every order
+static
+Array<String8> LabelCorpus(Arena* arena) {
+  auto labels = NewGrowableArray<String8>(arena);
+  for (usize i = 0; i < 20000; ++i) {
+    Push(labels, Format(arena, "Button %zu", i));
+    Push(labels, Format(arena, "Item %zu", i));
+    Push(labels, Format(arena, "Window##%zu", i));
+    Push(labels, Format(arena, "Row %zu, Col %zu", i / 100, i % 100));
+  }
+  // Short codes, like hotkeys and cell names
+  const char ALNUM[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+  const usize NUM_ALNUM = sizeof(ALNUM) - 1;
+  for (usize i = 0; i < NUM_ALNUM * NUM_ALNUM * NUM_ALNUM; ++i) {
+    auto ptr = (char*)AllocBytes(arena, 3);
+    ptr[0] = ALNUM[i % NUM_ALNUM];
+    ptr[1] = ALNUM[i / NUM_ALNUM % NUM_ALNUM];
+    ptr[2] = ALNUM[i / NUM_ALNUM / NUM_ALNUM];
+    Push(labels, { .ptr = ptr, .len = i < NUM_ALNUM * NUM_ALNUM ? (usize)2 : (usize)3 });
+  }
+  char word[] = "abcdefg";
+  std::sort(word, word + 7);
+  do {
+    auto ptr = (char*)AllocBytes(arena, 7);
+    memcpy(ptr, word, 7);
+    Push(labels, { .ptr = ptr, .len = 7 });
+  } while (std::next_permutation(word, word + 7));
+  return labels;
+}
+
+static
+usize CountCollisions(Array<u64> hashes) {
+  std::sort(begin(hashes), end(hashes));
+  usize collisions = 0;
+  for (usize i = 1; i < hashes->len; ++i) {
+    collisions += hashes->buffer[i] == hashes->buffer[i - 1];
+  }
+  return collisions;
+}
+
+static
+void BenchHash() {
+  const char* name = "hash";
+  if (!Selected(name)) { return; }
+
+  Arena arena = NewVirtualArena(256 * 1024 * 1024);
+  auto labels = LabelCorpus(&arena);
+  auto hashes = NewGrowableArray<u64>(&arena, labels->len * 4);
+
+  // Labels, and the same labels scoped under a few parent ids
+  for (bool old : { true, false }) {
+    Clear(hashes);
+    for (u64 parent = 0; parent < 4; ++parent) {
+      for (auto label : labels) {
+        // Runtime strings have no precomputed hash
+        label.hash = 0;
+        auto hash = old ? OldHash(label) : Hash(label);
+        Push(hashes, parent == 0 ? hash : old ? OldHash(parent, hash) : Hash(parent, hash));
+      }
+    }
+    char variant[48];
+    snprintf(variant, sizeof(variant), "%s, %zu ids", old ? "old" : "wyhash", hashes->len);
+    Report(name, variant, CountCollisions(hashes), "collisions");
+  }
+
+  // Throughput on labels, and on longer runs of text
+  u64 sink = 0;
+  for (bool old : { true, false }) {
+    auto ns = NsPerIter(20, [&]() {
+      for (auto label : labels) {
+        label.hash = 0;
+        sink += old ? OldHash(label) : Hash(label);
+      }
+    });
+    Report(name, old ? "old, labels" : "wyhash, labels", ns / labels->len, "ns/label");
+  }
+  const usize BLOB_LEN = 4096;
+  auto blob = Alloc<char>(&arena, BLOB_LEN);
+  for (usize i = 0; i < BLOB_LEN; ++i) {
+    blob[i] = (char)(i * 31);
+  }
+  for (bool old : { true, false }) {
+    usize iter = 0;
+    auto ns = NsPerIter(20000, [&]() {
+      // Vary the input, so the hash cannot be hoisted out of the loop
+      String8 text = { .ptr = blob, .len = BLOB_LEN - iter++ % 8 };
+      sink += old ? OldHash(text) : Hash(text);
+    });
+    Report(name, old ? "old, 4 KB" : "wyhash, 4 KB", BLOB_LEN / ns, "bytes/ns");
+  }
+  if (sink == 42) {
+    printf("\n");
+  }
+  Free(&arena);
+}
+
+// Walks the glyphs like a real backend, with per-glyph advances
+static
+ui::Vec2 MeasureGlyphs(void*, ui::FontInfo, String8 text, f32 size) {
+  f32 width = 0;
+  for (usize i = 0; i < text.len; ++i) {
+    auto glyph = (u8)text.ptr[i];
+    width += size * (0.4f + (glyph % 7) * 0.05f);
+  }
+  return { width, size };
+}
+
+// Layout over thousands of labels, a share of which change every frame
+static
+void BenchTextCache() {
+  const char* name = "text_cache";
+  if (!Selected(name)) { return; }
+
+  const usize NUM_LABELS = 3000;
+  const usize NUM_FRAMES = 200;
+  for (usize churn_percent : { 0, 10, 100 }) {
+    auto ctx = ui::NewCtx();
+    ctx.measurer = { .measure = MeasureGlyphs };
+    Arena frame_arena = NewVirtualArena(256 * 1024 * 1024);
+    usize frame = 0;
+    auto ns = NsPerIter(NUM_FRAMES, [&]() {
+      auto ui = ui::BeginUi(&ctx, &frame_arena, { 0.0, 0.0, 1600.0, 900.0 });
+      ui::VList(ui);
+      for (usize i = 0; i < NUM_LABELS; ++i) {
+        bool churned = i % 100 < churn_percent;
+        // Churned labels show the frame number, like a live readout
+        auto label = churned ? Format(&frame_arena, "Value %zu: %zu", i, frame) : Format(&frame_arena, "Label %zu", i);
+        ui::Label(ui, label);
+      }
+      ui::PopParent(ui);
+      ui::EndUi(ui);
+      Reset(&frame_arena);
+      frame++;
+    });
+    auto cache = ctx.text_cache;
+    char variant[48];
+    snprintf(variant, sizeof(variant), "%zu%% churn, %.1f%% hits", churn_percent, 100.0 * cache.hits / (cache.hits + cache.misses));
+    Report(name, variant, ns, "ns/frame");
+    Free(&frame_arena);
+    ui::Destroy(&ctx);
+  }
+}
+
+// Layout as it was before the fused sweeps: a pass per step and axis
+static
+f32 ReduceChildren(ui::Ui* ui, ui::Widget parent, usize axis, bool sum) {
+  f32 accum = 0;
+  for (auto child = ui::ShapeOf(ui, parent)->tree.first_child; child != ui::NO_WIDGET; child = ui::ShapeOf(ui, child)->tree.sibling) {
+    auto value = ui::LayoutOf(ui, child)->computed_size[axis];
+    accum = sum ? accum + value : Max(accum, value);
+  }
+  return accum;
+}
+
+// The benchmark tree has no text, so the text pass is left out
+static
+void MultiPassLayout(ui::Ui* ui) {
+  auto num_widgets = (u32)ui::NumWidgets(ui);
+  for (u32 i = 0; i < num_widgets; ++i) {
+    *ui::LayoutOf(ui, { i }) = {};
+  }
+  for (usize axis = 0; axis < 2; ++axis) {
+    for (u32 i = 0; i < num_widgets; ++i) {
+      auto size = ui::ShapeOf(ui, { i })->logical_size[axis];
+      if (size.kind == ui::SizeKind::Pixels) {
+        ui::LayoutOf(ui, { i })->computed_size[axis] = size.value;
+      }
+    }
+    for (u32 i = num_widgets; i > 0; --i) {
+      ui::Widget widget = { i - 1 };
+      auto kind = ui::ShapeOf(ui, widget)->logical_size[axis].kind;
+      if (kind == ui::SizeKind::SumOfChildren || kind == ui::SizeKind::MaxOfChildren) {
+        ui::LayoutOf(ui, widget)->computed_size[axis] = ReduceChildren(ui, widget, axis, kind == ui::SizeKind::SumOfChildren);
+      }
+    }
+    for (u32 i = 0; i < num_widgets; ++i) {
+      auto shape = ui::ShapeOf(ui, { i });
+      auto size = shape->logical_size[axis];
+      if (size.kind == ui::SizeKind::PercentOfParent) {
+        auto parent_size = ui::LayoutOf(ui, shape->tree.parent)->computed_size[axis];
+        ui::LayoutOf(ui, { i })->computed_size[axis] = parent_size * size.value;
+      }
+    }
+  }
+  for (u32 i = 0; i < num_widgets; ++i) {
+    auto layout = ui::LayoutOf(ui, { i });
+    layout->bounds.w = layout->computed_size[0];
+    layout->bounds.h = layout->computed_size[1];
+  }
+  for (u32 i = 0; i < num_widgets; ++i) {
+    auto shape = ui::ShapeOf(ui, { i });
+    auto bounds = &ui::LayoutOf(ui, { i })->bounds;
+    bounds->x += shape->offset.x;
+    bounds->y += shape->offset.y;
+    ui::Vec2 cursor = { bounds->x, bounds->y };
+    for (auto child = shape->tree.first_child; child != ui::NO_WIDGET; child = ui::ShapeOf(ui, child)->tree.sibling) {
+      auto child_bounds = &ui::LayoutOf(ui, child)->bounds;
+      child_bounds->x = cursor.x;
+      child_bounds->y = cursor.y;
+      cursor.x += child_bounds->w * shape->growth_axis.x;
+      cursor.y += child_bounds->h * shape->growth_axis.y;
+    }
+  }
+}
+
+// Rows of spacers and half-width bars, about num_widgets in all
+static
+void BuildRows(ui::Ui* ui, usize num_widgets) {
+  ui::VList(ui);
+  for (usize row = 0; row < num_widgets / 10; ++row) {
+    ui::HList(ui);
+    for (usize i = 0; i < 7; ++i) {
+      ui::Space(ui);
+    }
+    auto bar = ui::AddWidget(ui);
+    ui::ShapeOf(ui, bar)->logical_size[0] = { ui::SizeKind::PercentOfParent, 0.5 };
+    ui::ShapeOf(ui, bar)->logical_size[1] = { ui::SizeKind::Pixels, 4.0 };
+    ui::PopParent(ui);
+    ui::Space(ui, ui::SpaceKind::CrossLine);
+  }
+  ui::PopParent(ui);
+}
+
+static
+void BenchLayout() {
+  const char* name = "layout";
+  if (!Selected(name)) { return; }
+
+  const usize NUM_WIDGETS = 10000;
+  auto ctx = ui::NewCtx();
+  Arena frame_arena = NewVirtualArena(256 * 1024 * 1024);
+  auto ui = ui::BeginUi(&ctx, &frame_arena, { 0.0, 0.0, 1600.0, 900.0 });
+  BuildRows(ui, NUM_WIDGETS);
+
+  // Both versions must agree before their times mean anything
+  MultiPassLayout(ui);
+  auto expected = NewFullArray<ui::Layout>(&frame_arena, ui::NumWidgets(ui));
+  memcpy(expected->buffer, ctx.layouts->buffer, sizeof(ui::Layout) * expected->len);
+  ui::ComputeLayout(ui);
+  usize mismatches = 0;
+  for (usize i = 0; i < expected->len; ++i) {
+    auto a = expected->buffer[i].bounds;
+    auto b = ctx.layouts->buffer[i].bounds;
+    mismatches += a.x != b.x || a.y != b.y || a.w != b.w || a.h != b.h;
+  }
+
+  char variant[48];
+  snprintf(variant, sizeof(variant), "multi-pass, %zu widgets", ui::NumWidgets(ui));
+  Report(name, variant, NsPerIter(1000, [&]() { MultiPassLayout(ui); }), "ns/layout");
+  snprintf(variant, sizeof(variant), "fused, %zu widgets", ui::NumWidgets(ui));
+  Report(name, variant, NsPerIter(1000, [&]() { ui::ComputeLayout(ui); }), "ns/layout");
+  Report(name, "mismatched bounds", mismatches, "widgets");
+
+  ui::EndUi(ui);
+  Free(&frame_arena);
+  ui::Destroy(&ctx);
+}
+
+// The same widget fields as one struct per widget, as before the
+// split into parallel arrays. The old widget held its font by value, so
+// this one carries the FontInfo too; its tree is indices, not the old
+// pointers, so it is 16 bytes smaller than the struct it stands for.
+struct AosWidget {
+  ui::WidgetBehavior behavior;
+  ui::WidgetShape shape;
+  ui::Layout layout;
+  ui::WidgetPaint paint;
+  ui::Text text;
+  ui::FontInfo font;
+};
+
+// Each pass below is written once, against one of these views, so the
+// two layouts run the same code and differ only in where fields live
+struct SoaWidgets {
+  ui::UiCtx* ctx;
+
+  u32 Count() { return this->ctx->behaviors->len; }
+  ui::WidgetBehavior* Behavior(u32 i) { return &this->ctx->behaviors->buffer[i]; }
+  ui::WidgetShape* Shape(u32 i) { return &this->ctx->shapes->buffer[i]; }
+  ui::Layout* Layout(u32 i) { return &this->ctx->layouts->buffer[i]; }
+  ui::WidgetPaint* Paint(u32 i) { return &this->ctx->paints->buffer[i]; }
+  ui::Text* Text(u32 i) { return &this->ctx->texts->buffer[i]; }
+  ui::FontInfo Font(u32 i) { return ui::GetFontInfo(this->ctx, this->Text(i)->font); }
+};
+
+struct AosWidgets {
+  Array<AosWidget> widgets;
+
+  u32 Count() { return this->widgets->len; }
+  ui::WidgetBehavior* Behavior(u32 i) { return &this->widgets->buffer[i].behavior; }
+  ui::WidgetShape* Shape(u32 i) { return &this->widgets->buffer[i].shape; }
+  ui::Layout* Layout(u32 i) { return &this->widgets->buffer[i].layout; }
+  ui::WidgetPaint* Paint(u32 i) { return &this->widgets->buffer[i].paint; }
+  ui::Text* Text(u32 i) { return &this->widgets->buffer[i].text; }
+  ui::FontInfo Font(u32 i) { return this->widgets->buffer[i].font; }
+};
+
+// ComputeLayout, measuring text directly instead of through the cache
+template <typename W>
+void LayoutPass(W w) {
+  auto num_widgets = w.Count();
+  for (u32 i = num_widgets; i > 0; --i) {
+    auto shape = w.Shape(i - 1);
+    auto layout = w.Layout(i - 1);
+    *layout = {};
+    auto text = w.Text(i - 1);
+    if (!IsEmpty(text->content)) {
+      layout->text_size = ui::MeasureMonospace(nullptr, w.Font(i - 1), text->content, text->size);
+    }
+    for (int axis = 0; axis < 2; ++axis) {
+      auto size = shape->logical_size[axis];
+      auto computed = &layout->computed_size[axis];
+      if (size.kind == ui::SizeKind::Pixels) {
+        *computed = size.value;
+      } else if (size.kind == ui::SizeKind::Text) {
+        *computed = (axis == 0 ? layout->text_size.x : layout->text_size.y) + 10.0;
+      } else if (size.kind == ui::SizeKind::SumOfChildren || size.kind == ui::SizeKind::MaxOfChildren) {
+        f32 accum = 0;
+        for (auto child = shape->tree.first_child; child != ui::NO_WIDGET; child = w.Shape(child.index)->tree.sibling) {
+          auto value = w.Layout(child.index)->computed_size[axis];
+          accum = size.kind == ui::SizeKind::SumOfChildren ? accum + value : Max(accum, value);
+        }
+        *computed = accum;
+      }
+    }
+  }
+
+  auto root = w.Layout(0);
+  root->bounds.w = root->computed_size[0];
+  root->bounds.h = root->computed_size[1];
+  for (u32 i = 0; i < num_widgets; ++i) {
+    auto shape = w.Shape(i);
+    auto layout = w.Layout(i);
+    layout->bounds.x += shape->offset.x;
+    layout->bounds.y += shape->offset.y;
+    ui::Vec2 cursor = { layout->bounds.x, layout->bounds.y };
+    for (auto child = shape->tree.first_child; child != ui::NO_WIDGET; child = w.Shape(child.index)->tree.sibling) {
+      auto child_shape = w.Shape(child.index);
+      auto child_layout = w.Layout(child.index);
+      for (int axis = 0; axis < 2; ++axis) {
+        auto size = child_shape->logical_size[axis];
+        if (size.kind == ui::SizeKind::PercentOfParent) {
+          child_layout->computed_size[axis] = layout->computed_size[axis] * size.value;
+        }
+      }
+      auto bounds = &child_layout->bounds;
+      *bounds = { cursor.x, cursor.y, child_layout->computed_size[0], child_layout->computed_size[1] };
+      cursor.x += bounds->w * shape->growth_axis.x;
+      cursor.y += bounds->h * shape->growth_axis.y;
+    }
+  }
+}
+
+// BuildHitGrid's scans: bound the hoverable widgets, then bucket them
+// into cells, counting and filling. Returns the number of entries.
+template <typename W>
+usize HitGridPass(W w, Arena* arena) {
+  auto hoverable = [&](u32 i) {
+    auto behavior = w.Behavior(i);
+    return behavior->id != ui::NO_ID && !behavior->mouse_transparent;
+  };
+  ui::Rect grid;
+  usize num_hoverable = 0;
+  for (u32 i = 0; i < w.Count(); ++i) {
+    if (!hoverable(i)) { continue; }
+    auto b = w.Layout(i)->bounds;
+    if (num_hoverable++ == 0) {
+      grid = b;
+    } else {
+      f32 right = std::max(grid.x + grid.w, b.x + b.w);
+      f32 bottom = std::max(grid.y + grid.h, b.y + b.h);
+      grid.x = std::min(grid.x, b.x);
+      grid.y = std::min(grid.y, b.y);
+      grid = { grid.x, grid.y, right - grid.x, bottom - grid.y };
+    }
+  }
+  const u32 DIM = 64;
+  auto cell_start = AllocZero<u32>(arena, DIM * DIM + 1);
+  auto for_each_cell = [&](u32 i, auto&& fn) {
+    auto b = w.Layout(i)->bounds;
+    auto cell = [&](f32 value, f32 origin, f32 extent) {
+      return (u32)Min<f32>(Max<f32>((value - origin) / extent * DIM, 0.0), DIM - 1);
+    };
+    for (auto row = cell(b.y, grid.y, grid.h); row <= cell(b.y + b.h, grid.y, grid.h); ++row) {
+      for (auto col = cell(b.x, grid.x, grid.w); col <= cell(b.x + b.w, grid.x, grid.w); ++col) {
+        fn(row * DIM + col);
+      }
+    }
+  };
+  for (u32 i = 0; i < w.Count(); ++i) {
+    if (!hoverable(i)) { continue; }
+    for_each_cell(i, [&](u32 c) { cell_start[c + 1]++; });
+  }
+  for (u32 c = 0; c < DIM * DIM; ++c) {
+    cell_start[c + 1] += cell_start[c];
+  }
+  auto items = Alloc<u32>(arena, cell_start[DIM * DIM]);
+  for (u32 i = 0; i < w.Count(); ++i) {
+    if (!hoverable(i)) { continue; }
+    for_each_cell(i, [&](u32 c) { items[cell_start[c]++] = i; });
+  }
+  return cell_start[DIM * DIM - 1];
+}
+
+// EmitDrawList, without the text copies into the frame arena
+template <typename W>
+void EmitPass(W w, Array<ui::DrawCmd> draw_list) {
+  Clear(draw_list);
+  Push(draw_list, { .kind = ui::DrawCmdKind::Clip, .bounds = w.Layout(0)->bounds });
+  for (u32 i = 0; i < w.Count(); ++i) {
+    auto layout = w.Layout(i);
+    auto paint = w.Paint(i);
+    auto bounds = layout->bounds;
+    bool rounded = paint->rounding > 0.0;
+    if (paint->fill.a != 0) {
+      Push(draw_list, {
+        .kind = rounded ? ui::DrawCmdKind::RoundedRect : ui::DrawCmdKind::Rect,
+        .color = paint->fill,
+        .bounds = bounds,
+        .rounding = paint->rounding,
+      });
+    }
+    auto stroke = paint->stroke;
+    if (stroke.thickness > 0 && stroke.color.a != 0) {
+      Push(draw_list, {
+        .kind = rounded ? ui::DrawCmdKind::RoundedStroke : ui::DrawCmdKind::Stroke,
+        .color = stroke.color,
+        .bounds = bounds,
+        .rounding = paint->rounding,
+        .thickness = stroke.thickness,
+      });
+    }
+    auto text = w.Text(i);
+    if (!IsEmpty(text->content)) {
+      auto text_size = layout->text_size;
+      Push(draw_list, {
+        .kind = ui::DrawCmdKind::Text,
+        .color = text->color,
+        .bounds = {
+          .x = bounds.x + (bounds.w - text_size.x) / 2.0f,
+          .y = bounds.y + (bounds.h - text_size.y) / 2.0f,
+          .w = text_size.x,
+          .h = text_size.y,
+        },
+        .text = text->content.ptr,
+        .font = w.Font(i),
+        .text_size = (f32)text->size,
+        .hash = Hash(text->content),
+      });
+    }
+  }
+  Push(draw_list, { .kind = ui::DrawCmdKind::Unclip });
+}
+
+// Layout, hit grid and draw list passes over the same widgets, stored
+// as parallel arrays and as one struct per widget
+static
+void BenchWidgetLayouts() {
+  const char* name = "widget_layouts";
+  if (!Selected(name)) { return; }
+
+  // About 8k widgets, whose arrays fit in cache, and 83k, which do not
+  for (usize num_windows : { 10000 / 6, 100000 / 6 }) {
+    auto ctx = ui::NewCtx();
+    Arena frame_arena = NewVirtualArena(256 * 1024 * 1024);
+    Arena arena = NewVirtualArena(256 * 1024 * 1024);
+    auto ui = ui::BeginUi(&ctx, &frame_arena, { 0.0, 0.0, 1600.0, 900.0 });
+    BuildWindows(ui, num_windows);
+    ui::EndUi(ui);
+    auto num_widgets = (u32)ui::NumWidgets(ui);
+
+    SoaWidgets soa = { .ctx = &ctx };
+    AosWidgets aos = { .widgets = NewFullArray<AosWidget>(&arena, num_widgets) };
+    for (u32 i = 0; i < num_widgets; ++i) {
+      aos.widgets->buffer[i] = {
+        .behavior = *soa.Behavior(i),
+        .shape = *soa.Shape(i),
+        .layout = {},
+        .paint = *soa.Paint(i),
+        .text = *soa.Text(i),
+        .font = soa.Font(i),
+      };
+    }
+
+    // The ports must agree with EndUi, and with each other
+    auto expected = NewFullArray<ui::Layout>(&arena, num_widgets);
+    memcpy(expected->buffer, ctx.layouts->buffer, sizeof(ui::Layout) * num_widgets);
+    LayoutPass(soa);
+    LayoutPass(aos);
+    usize mismatches = 0;
+    for (u32 i = 0; i < num_widgets; ++i) {
+      for (auto layout : { soa.Layout(i), aos.Layout(i) }) {
+        mismatches += memcmp(layout, &expected->buffer[i], sizeof(ui::Layout)) != 0;
+      }
+    }
+    auto soa_cmds = NewGrowableArray<ui::DrawCmd>(&arena, 4 * num_widgets);
+    auto aos_cmds = NewGrowableArray<ui::DrawCmd>(&arena, 4 * num_widgets);
+    EmitPass(soa, soa_cmds);
+    EmitPass(aos, aos_cmds);
+    mismatches += soa_cmds->len != ui->draw_list->len || aos_cmds->len != ui->draw_list->len;
+    Arena scratch = NewVirtualArena(64 * 1024 * 1024);
+    mismatches += HitGridPass(soa, &scratch) != HitGridPass(aos, &scratch);
+    Reset(&scratch);
+
+    char variant[48];
+    const usize ITERS = 2000000 / num_widgets;
+    volatile usize sink = 0;
+    auto report = [&](const char* pass, const char* layout, f64 ns) {
+      snprintf(variant, sizeof(variant), "%s, %s, %uk", pass, layout, (num_widgets + 500) / 1000);
+      Report(name, variant, ns / num_widgets, "ns/widget");
+    };
+    report("layout", "arrays", NsPerIter(ITERS, [&]() { LayoutPass(soa); }));
+    report("layout", "structs", NsPerIter(ITERS, [&]() { LayoutPass(aos); }));
+    report("hit grid", "arrays", NsPerIter(ITERS, [&]() { sink = sink + HitGridPass(soa, &scratch); Reset(&scratch); }));
+    report("hit grid", "structs", NsPerIter(ITERS, [&]() { sink = sink + HitGridPass(aos, &scratch); Reset(&scratch); }));
+    report("draw list", "arrays", NsPerIter(ITERS, [&]() { EmitPass(soa, soa_cmds); }));
+    report("draw list", "structs", NsPerIter(ITERS, [&]() { EmitPass(aos, aos_cmds); }));
+    snprintf(variant, sizeof(variant), "mismatches, %u widgets", num_widgets);
+    Report(name, variant, mismatches, "");
+
+    Free(&scratch);
+    Free(&arena);
+    Free(&frame_arena);
+    ui::Destroy(&ctx);
+  }
+}
+
+MAKE_SLOTMAP_KEY(Entity);
+
+struct Particle {
+  f32 position[3];
+  f32 velocity[3];
+  f32 age;
+  u32 flags;
+};
+
+// Sums a field over every live value, the way a system update would
+template <typename Map>
+f32 SumAges(Map* sm) {
+  f32 sum = 0.0;
+  auto iter = Iter(sm);
+  while (auto entry = Next(&iter)) {
+    sum += entry.value->age;
+  }
+  return sum;
+}
+
+// Iteration and lookup for both slotmaps, with a share of the values
+// removed at random: the dense map's scan only ever sees live values,
+// the sparse one skips holes through the occupancy bitmap
+static
+void BenchSlotMaps() {
+  const char* name = "slotmaps";
+  if (!Selected(name)) { return; }
+
+  const usize NUM_VALUES = 100000;
+  Arena arena = NewVirtualArena(64 * 1024 * 1024);
+  std::mt19937 rng(1234);
+  volatile f32 sink = 0.0;
+  for (usize fill : { 100, 50, 10 }) {
+    auto sparse = NewSlotMap<Entity, Particle>(&arena);
+    DenseSlotMap<Entity, Particle> dense{};
+    auto sparse_keys = NewFullArray<Entity>(&arena, NUM_VALUES);
+    auto dense_keys = NewFullArray<Entity>(&arena, NUM_VALUES);
+    for (usize i = 0; i < NUM_VALUES; ++i) {
+      Particle particle = { .age = (f32)i };
+      sparse_keys->buffer[i] = Insert(&sparse, particle);
+      dense_keys->buffer[i] = Insert(&dense, particle);
+    }
+    // Same shuffle for both, so they lose the same values
+    auto order = NewFullArray<u32>(&arena, NUM_VALUES);
+    for (usize i = 0; i < NUM_VALUES; ++i) {
+      order->buffer[i] = i;
+    }
+    std::shuffle(begin(order), end(order), rng);
+    usize num_live = NUM_VALUES * fill / 100;
+    for (usize i = num_live; i < NUM_VALUES; ++i) {
+      Remove(&sparse, sparse_keys->buffer[order->buffer[i]]);
+      Remove(&dense, dense_keys->buffer[order->buffer[i]]);
+    }
+
+    char variant[48];
+    auto ns = NsPerIter(100, [&]() { sink = sink + SumAges(&sparse); });
+    snprintf(variant, sizeof(variant), "iterate sparse, %zu%% full", fill);
+    Report(name, variant, ns / num_live, "ns/value");
+    ns = NsPerIter(100, [&]() { sink = sink + SumAges(&dense); });
+    snprintf(variant, sizeof(variant), "iterate dense, %zu%% full", fill);
+    Report(name, variant, ns / num_live, "ns/value");
+
+    // Lookups in random order, over the live keys
+    ns = NsPerIter(100, [&]() {
+      f32 sum = 0.0;
+      for (usize i = 0; i < num_live; ++i) {
+        sum += Get(&sparse, sparse_keys->buffer[order->buffer[i]])->age;
+      }
+      sink = sink + sum;
+    });
+    snprintf(variant, sizeof(variant), "get sparse, %zu%% full", fill);
+    Report(name, variant, ns / num_live, "ns/get");
+    ns = NsPerIter(100, [&]() {
+      f32 sum = 0.0;
+      for (usize i = 0; i < num_live; ++i) {
+        sum += Get(&dense, dense_keys->buffer[order->buffer[i]])->age;
+      }
+      sink = sink + sum;
+    });
+    snprintf(variant, sizeof(variant), "get dense, %zu%% full", fill);
+    Report(name, variant, ns / num_live, "ns/get");
+
+    Free(&dense);
+    Reset(&arena);
+  }
+  Free(&arena);
+}
+
+// Threads that each insert, read back and remove in batches, sharing
+// one map: contention is on the free stack and the slot counter
+static
+void BenchConcurrentSlotMap() {
+  const char* name = "concurrent_slotmap";
+  if (!Selected(name)) { return; }
+
+  const usize NUM_OPS = 200000;
+  const usize BATCH = 64;
+  for (usize num_threads : { 1, 2, 4, 8 }) {
+    ConcurrentSlotMap<Entity, Particle> map;
+    auto work = [&]() {
+      Entity keys[BATCH];
+      Particle out;
+      f32 sum = 0.0;
+      for (usize i = 0; i < NUM_OPS; i += BATCH) {
+        for (usize j = 0; j < BATCH; ++j) {
+          keys[j] = Insert(&map, Particle{ .age = (f32)j });
+        }
+        for (usize j = 0; j < BATCH; ++j) {
+          sum += Get(&map, keys[j], &out) ? out.age : 0.0;
+        }
+        for (usize j = 0; j < BATCH; ++j) {
+          Remove(&map, keys[j]);
+        }
+      }
+      return sum;
+    };
+    auto ns = NsPerIter(5, [&]() {
+      std::thread threads[8];
+      for (usize i = 0; i < num_threads; ++i) {
+        threads[i] = std::thread(work);
+      }
+      for (usize i = 0; i < num_threads; ++i) {
+        threads[i].join();
+      }
+    });
+    char variant[48];
+    snprintf(variant, sizeof(variant), "%zu threads", num_threads);
+    // Each op is an insert, a get and a remove
+    Report(name, variant, num_threads * NUM_OPS / ns * 1000.0, "M ops/s");
+    Free(&map);
+  }
+}
+
+// InsertMany and RemoveMany against the same work done one call at a
+// time, into fresh nodes and into a map whose nodes were all freed
+static
+void BenchSlotMapBulk() {
+  const char* name = "slotmap_bulk";
+  if (!Selected(name)) { return; }
+
+  const usize NUM_VALUES = 100000;
+  Arena arena = NewVirtualArena(64 * 1024 * 1024);
+  auto values = NewFullArray<Particle>(&arena, NUM_VALUES);
+  for (usize i = 0; i < NUM_VALUES; ++i) {
+    values->buffer[i] = { .age = (f32)i };
+  }
+  auto keys = NewGrowableArray<Entity>(&arena, NUM_VALUES);
+
+  for (bool reuse : { false, true }) {
+    const char* nodes = reuse ? "freed nodes" : "fresh nodes";
+    char variant[48];
+    SlotMap<Entity, Particle> sm{};
+    // Every round starts from a new map: empty, or holding exactly
+    // NUM_VALUES nodes, all on the free list
+    auto prepare = [&]() {
+      Free(&sm);
+      if (reuse) {
+        InsertMany(&sm, values, keys);
+        RemoveMany(&sm, keys);
+        assert(sm.num_free == NUM_VALUES && sm.capacity == NUM_VALUES);
+      }
+      Clear(keys);
+    };
+
+    f64 single_ns = 0.0;
+    f64 bulk_ns = 0.0;
+    for (usize round = 0; round < 20; ++round) {
+      prepare();
+      auto start = std::chrono::steady_clock::now();
+      for (usize i = 0; i < NUM_VALUES; ++i) {
+        keys->buffer[i] = Insert(&sm, values->buffer[i]);
+      }
+      keys->len = NUM_VALUES;
+      single_ns += std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+      prepare();
+      start = std::chrono::steady_clock::now();
+      InsertMany(&sm, values, keys);
+      bulk_ns += std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    snprintf(variant, sizeof(variant), "insert, %s", nodes);
+    Report(name, variant, single_ns / (20 * NUM_VALUES), "ns/value");
+    snprintf(variant, sizeof(variant), "insert many, %s", nodes);
+    Report(name, variant, bulk_ns / (20 * NUM_VALUES), "ns/value");
+    Free(&sm);
+  }
+
+  // Removing every value, in insertion order
+  SlotMap<Entity, Particle> sm{};
+  f64 single_ns = 0.0;
+  f64 bulk_ns = 0.0;
+  for (usize round = 0; round < 20; ++round) {
+    Clear(keys);
+    InsertMany(&sm, values, keys);
+    auto start = std::chrono::steady_clock::now();
+    for (usize i = 0; i < NUM_VALUES; ++i) {
+      Remove(&sm, keys->buffer[i]);
+    }
+    single_ns += std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    Clear(keys);
+    InsertMany(&sm, values, keys);
+    start = std::chrono::steady_clock::now();
+    RemoveMany(&sm, keys);
+    bulk_ns += std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count();
+  }
+  Report(name, "remove", single_ns / (20 * NUM_VALUES), "ns/value");
+  Report(name, "remove many", bulk_ns / (20 * NUM_VALUES), "ns/value");
+  Free(&sm);
+  Free(&arena);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    filter = argv[1];
+  }
+  BenchWidgetCache();
+  BenchArenaZeroing();
+  BenchHash();
+  BenchTextCache();
+  BenchLayout();
+  BenchWidgetLayouts();
+  BenchSlotMaps();
+  BenchConcurrentSlotMap();
+  BenchSlotMapBulk();
+  return 0;
+}
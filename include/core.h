@@ -6,6 +6,11 @@
 #include <cstring>
 #include <iostream>
 #include <cassert>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 using u8 = uint8_t;
 using u16 = uint16_t;
@@ -41,6 +46,16 @@ privDefer<F> defer_func(F f) {
 #define DEFER_3(x)    DEFER_2(x, __COUNTER__)
 #define defer(code)   auto DEFER_3(_defer_) = defer_func([&](){code;})
 
+// Arena statistics are compiled out of release builds,
+// unless CORE_ARENA_STATS is set explicitly
+#ifndef CORE_ARENA_STATS
+  #ifdef NDEBUG
+    #define CORE_ARENA_STATS 0
+  #else
+    #define CORE_ARENA_STATS 1
+  #endif
+#endif
+
 namespace core {
   // Common utility
   template <typename T>
@@ -48,6 +63,11 @@ namespace core {
     return x > y ? x : y;
   }
 
+  template <typename T>
+  T Min(T x, T y) {
+    return x < y ? x : y;
+  }
+
   template <typename T>
   void Swap(T* a, T* b) {
     T temp = *a;
@@ -63,11 +83,57 @@ namespace core {
     ArenaChunk* next{nullptr};
   };
 
+#if CORE_ARENA_STATS
+  struct ArenaGrowth {
+    // Bytes added by the growth: a new chunk, or newly committed pages
+    usize num_bytes{0};
+    // Bytes in use when the arena had to grow
+    usize used_bytes{0};
+  };
+
+  const usize ARENA_GROWTH_LOG_SIZE = 16;
+
+  struct ArenaStats {
+    // Bytes handed out since the last Reset, alignment padding included
+    usize used_bytes{0};
+    // Value of used_bytes at the last Reset, i.e. a frame's worth
+    usize last_used_bytes{0};
+    usize peak_bytes{0};
+    usize num_allocs{0};
+    usize num_growths{0};
+    // Free tail bytes left behind in chunks abandoned by growth
+    usize wasted_bytes{0};
+    // Ring buffer of the most recent growth events:
+    // the latest is at (num_growths - 1) % ARENA_GROWTH_LOG_SIZE
+    ArenaGrowth growths[ARENA_GROWTH_LOG_SIZE];
+  };
+#endif
+
+  // Resets over which a virtual arena remembers its peak use
+  const usize ARENA_PEAK_WINDOW = 16;
+
   struct Arena {
     ArenaChunk* first{nullptr};
     ArenaChunk* last{nullptr};
     usize capacity{0};
     usize num_chunks{0};
+    // Virtual arenas reserve `reserved` bytes of address space up front,
+    // and commit pages on demand into their single chunk.
+    // A value of 0 means the arena grows by chaining chunks instead.
+    usize reserved{0};
+    // On Reset, virtual arenas decommit the pages above this many bytes,
+    // or above the peak of recent frames if that is higher, so a steady
+    // load above the threshold is not recommitted every frame.
+    // A value of 0 keeps everything committed.
+    usize decommit_above{0};
+    // Virtual arenas: furthest the cursor got since the last Reset,
+    // and in each of the last ARENA_PEAK_WINDOW frames
+    usize frame_peak{0};
+    usize recent_peaks[ARENA_PEAK_WINDOW]{};
+    usize num_resets{0};
+#if CORE_ARENA_STATS
+    ArenaStats stats;
+#endif
   };
 
   template <typename T>
@@ -77,30 +143,79 @@ namespace core {
     }
   }
 
+  // Alignment for hot arrays, so they do not share cache lines
+  const usize CACHE_LINE_SIZE = 64;
+
   Arena NewArena(usize capacity);
-  u8* AllocBytes(Arena* arena, usize num_bytes);
+  Arena NewVirtualArena(usize reserve, usize decommit_above = 0);
+  // align must be a power of two
+  u8* AllocBytes(Arena* arena, usize num_bytes, usize align = 1);
+  // Extends the most recent allocation without moving it, if there is room
+  bool GrowInPlace(Arena* arena, u8* ptr, usize old_bytes, usize new_bytes);
+  // Arena memory is not zeroed, neither on growth nor on Reset:
+  // use this when the bytes must start out as zero
+  u8* AllocZeroBytes(Arena* arena, usize num_bytes, usize align = 1);
 
   void Free(Arena* arena);
   void Reset(Arena* arena);
 
+  // Save-point in an arena: EndTemp rewinds everything allocated
+  // since the matching BeginTemp
+  struct ArenaTemp {
+    Arena* arena{nullptr};
+    ArenaChunk* chunk{nullptr};
+    usize cursor{0};
+#if CORE_ARENA_STATS
+    usize used_bytes{0};
+#endif
+  };
+
+  ArenaTemp BeginTemp(Arena* arena);
+  void EndTemp(ArenaTemp temp);
+
+  // Thread-local arena for transient work. Pass the arena the caller is
+  // already allocating into as `conflict`, so the two never alias.
+  Arena* GetScratch(Arena* conflict = nullptr);
+
+  // Rewinds the arena at the end of the enclosing scope
+  #define temp_scope(name, arena) \
+    auto name = core::BeginTemp(arena); defer(core::EndTemp(name))
+
   template <typename T>
   T* Alloc(Arena* arena) {
-    auto buffer = AllocBytes(arena, sizeof(T));
+    auto buffer = AllocBytes(arena, sizeof(T), alignof(T));
     return new(buffer) T;
   }
 
   template <typename T>
-  T* Alloc(Arena* arena, usize num_items) {
-    auto buffer = AllocBytes(arena, sizeof(T) * num_items);
+  T* Alloc(Arena* arena, usize num_items, usize align = alignof(T)) {
+    auto buffer = AllocBytes(arena, sizeof(T) * num_items, Max(align, alignof(T)));
     return new(buffer) T[num_items];
   }
 
+  template <typename T>
+  T* AllocZero(Arena* arena, usize num_items = 1, usize align = alignof(T)) {
+    auto buffer = AllocZeroBytes(arena, sizeof(T) * num_items, Max(align, alignof(T)));
+    return (T*)buffer;
+  }
+
+  template <typename T>
+  T* AllocCacheAligned(Arena* arena, usize num_items) {
+    return Alloc<T>(arena, num_items, CACHE_LINE_SIZE);
+  }
+
   // Array
   template <typename T>
   struct ArrayData {
     usize len{0};
     usize capacity{0};
     T* buffer{nullptr};
+    // The arena holding the buffer, used by Reserve to reallocate it
+    Arena* arena{nullptr};
+    // Alignment the buffer was asked for, kept when it moves
+    usize align{0};
+    // Growable arrays reallocate on Push when full, instead of failing
+    bool growable{false};
   };
 
   template <typename T>
@@ -118,27 +233,89 @@ namespace core {
   
 
   template <typename T>
-  Array<T> NewEmptyArray(Arena* arena, usize capacity) {
+  Array<T> NewEmptyArray(Arena* arena, usize capacity, usize align = alignof(T)) {
     Array<T> array = Alloc<ArrayData<T>>(arena);
     array->capacity = capacity;
     array->len = 0;
-    array->buffer = Alloc<T>(arena, capacity);
+    // Items are constructed as they are pushed
+    array->align = Max(align, alignof(T));
+    array->buffer = (T*)AllocBytes(arena, sizeof(T) * capacity, array->align);
+    array->arena = arena;
     return array;
   }
 
   template <typename T>
-  Array<T> NewFullArray(Arena* arena, usize length) {
+  Array<T> NewFullArray(Arena* arena, usize length, usize align = alignof(T)) {
     Array<T> array = Alloc<ArrayData<T>>(arena);
     array->capacity = length;
     array->len = length;
-    array->buffer = Alloc<T>(arena, length);
+    array->align = Max(align, alignof(T));
+    array->buffer = Alloc<T>(arena, length, array->align);
+    array->arena = arena;
+    return array;
+  }
+
+  template <typename T>
+  Array<T> NewGrowableArray(Arena* arena, usize capacity = 8, usize align = alignof(T)) {
+    Array<T> array = NewEmptyArray<T>(arena, capacity, align);
+    array->growable = true;
     return array;
   }
 
+  // Ends the lifetime of items removed from an array. Trivial items are
+  // zeroed instead, as arrays always have.
+  template <typename T>
+  void DestroyItems(T* items, usize num_items) {
+    if constexpr (std::is_trivially_destructible_v<T>) {
+      ZeroOut(items, num_items);
+    } else {
+      for (usize i = 0; i < num_items; ++i) {
+        items[i].~T();
+      }
+    }
+  }
+
+  // Reallocates the buffer in the array's arena, so it fits at least
+  // capacity items. Pointers into the array are invalidated if it moves.
+  template <typename T>
+  void Reserve(Array<T> array, usize capacity) {
+    if (capacity <= array->capacity) {
+      return;
+    }
+    assert(array->arena);
+    auto old_bytes = sizeof(T) * array->capacity;
+    auto new_bytes = sizeof(T) * capacity;
+    if (!GrowInPlace(array->arena, (u8*)array->buffer, old_bytes, new_bytes)) {
+      auto buffer = (T*)AllocBytes(array->arena, new_bytes, Max(array->align, alignof(T)));
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        memcpy(buffer, array->buffer, sizeof(T) * array->len);
+      } else {
+        for (usize i = 0; i < array->len; ++i) {
+          new(&buffer[i]) T(std::move(array->buffer[i]));
+          array->buffer[i].~T();
+        }
+      }
+      array->buffer = buffer;
+    }
+    array->capacity = capacity;
+  }
+
+  // Like Reserve, but at least doubles the capacity so repeated
+  // growth is amortized
+  template <typename T>
+  void GrowToFit(Array<T> array, usize capacity) {
+    if (capacity > array->capacity) {
+      Reserve(array, Max(capacity, array->capacity * 2));
+    }
+  }
+
   template <typename T>
   bool Push(Array<T> array, T value) {
+    if (array->len == array->capacity && array->growable) {
+      GrowToFit(array, Max<usize>(array->len + 1, 8));
+    }
     if (array->len < array->capacity) {
-      array->buffer[array->len] = value;
+      new(&array->buffer[array->len]) T(std::move(value));
       array->len++;
       return true;
     } else {
@@ -146,13 +323,44 @@ namespace core {
     }
   }
 
+  // Sets the length, value-initializing new items and destroying removed ones
+  template <typename T>
+  void Resize(Array<T> array, usize len) {
+    GrowToFit(array, len);
+    for (usize i = array->len; i < len; ++i) {
+      new(&array->buffer[i]) T{};
+    }
+    if (len < array->len) {
+      DestroyItems(&array->buffer[len], array->len - len);
+    }
+    array->len = len;
+  }
+
+  template <typename T>
+  void Extend(Array<T> array, const T* items, usize num_items) {
+    GrowToFit(array, array->len + num_items);
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      memcpy(&array->buffer[array->len], items, sizeof(T) * num_items);
+    } else {
+      for (usize i = 0; i < num_items; ++i) {
+        new(&array->buffer[array->len + i]) T(items[i]);
+      }
+    }
+    array->len += num_items;
+  }
+
+  template <typename T>
+  void Extend(Array<T> array, Array<T> other) {
+    Extend(array, other->buffer, other->len);
+  }
+
   template <typename T>
   T Pop(Array<T> array) {
     assert(array->len > 0);
     array->len--;
     auto* ptr = &array->buffer[array->len];
-    T value = *ptr;
-    ZeroOut(ptr);
+    T value = std::move(*ptr);
+    DestroyItems(ptr, 1);
     return value;
   }
 
@@ -192,7 +400,7 @@ namespace core {
 
   template <typename T>
   void Clear(Array<T> array) {
-    ZeroOut(array->buffer, array->len);
+    DestroyItems(array->buffer, array->len);
     array->len = 0;
   }
 
@@ -200,19 +408,125 @@ namespace core {
   struct String8  {
     const char* ptr = "\0";
     usize len{0};
+    // Precomputed Hash(*this), or 0 if unknown
+    u64 hash{0};
 
     friend std::ostream& operator<<(std::ostream& os, const String8& dt);
   };
 
-  // IMPORTANT: Only use with literals!
-  String8 Lit(const char* lit);
   String8 SubstringUntil(String8 base, char ch);
   bool IsEmpty(String8 str);
   const char* CStr(Arena* arena, String8 string);
 
-  // Hashing
-  u64 Hash(u64 x, u64 y);
-  u64 Hash(String8 str);
+  // Hashing (wyhash)
+  // Everything is constexpr, so literals can be hashed at compile time
+  constexpr u64 HASH_SECRET[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+  };
+
+  // 64x64 -> 128 bit multiply, returning the low and high halves
+  constexpr void MulFold(u64* a, u64* b) {
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+  }
+
+  constexpr u64 Mix(u64 a, u64 b) {
+    MulFold(&a, &b);
+    return a ^ b;
+  }
+
+  // Little-endian reads, spelled out byte by byte to stay constexpr:
+  // compilers fold them into single loads
+  constexpr u64 Read4(const char* p) {
+    return (u64)(u8)p[0] | (u64)(u8)p[1] << 8 | (u64)(u8)p[2] << 16 | (u64)(u8)p[3] << 24;
+  }
+
+  constexpr u64 Read8(const char* p) {
+    return Read4(p) | Read4(p + 4) << 32;
+  }
+
+  constexpr u64 Read3(const char* p, usize k) {
+    return (u64)(u8)p[0] << 16 | (u64)(u8)p[k >> 1] << 8 | (u64)(u8)p[k - 1];
+  }
+
+  // Combines two values. Chain it to hash sequences,
+  // e.g. Hash(parent_id, child_id) for hierarchical ids.
+  constexpr u64 Hash(u64 x, u64 y) {
+    x ^= HASH_SECRET[0];
+    y ^= HASH_SECRET[1];
+    MulFold(&x, &y);
+    return Mix(x ^ HASH_SECRET[0], y ^ HASH_SECRET[1]);
+  }
+
+  constexpr u64 HashBytes(const char* p, usize len, u64 seed = 0) {
+    seed ^= Mix(seed ^ HASH_SECRET[0], HASH_SECRET[1]);
+
+    u64 a = 0;
+    u64 b = 0;
+    if (len <= 16) {
+      if (len >= 4) {
+        // Two overlapping 4-byte reads from each end cover 4..16 bytes
+        usize mid = (len >> 3) << 2;
+        a = (Read4(p) << 32) | Read4(p + mid);
+        b = (Read4(p + len - 4) << 32) | Read4(p + len - 4 - mid);
+      } else if (len > 0) {
+        a = Read3(p, len);
+      }
+    } else {
+      usize i = len;
+      // Three independent lanes of 16 bytes each
+      if (i >= 48) {
+        u64 seed1 = seed;
+        u64 seed2 = seed;
+        do {
+          seed = Mix(Read8(p) ^ HASH_SECRET[1], Read8(p + 8) ^ seed);
+          seed1 = Mix(Read8(p + 16) ^ HASH_SECRET[2], Read8(p + 24) ^ seed1);
+          seed2 = Mix(Read8(p + 32) ^ HASH_SECRET[3], Read8(p + 40) ^ seed2);
+          p += 48;
+          i -= 48;
+        } while (i >= 48);
+        seed ^= seed1 ^ seed2;
+      }
+      while (i > 16) {
+        seed = Mix(Read8(p) ^ HASH_SECRET[1], Read8(p + 8) ^ seed);
+        p += 16;
+        i -= 16;
+      }
+      a = Read8(p + i - 16);
+      b = Read8(p + i - 8);
+    }
+
+    a ^= HASH_SECRET[1];
+    b ^= seed;
+    MulFold(&a, &b);
+    return Mix(a ^ HASH_SECRET[0] ^ len, b ^ HASH_SECRET[1]);
+  }
+
+  // Uses the precomputed hash when there is one
+  constexpr u64 Hash(String8 str, u64 seed = 0) {
+    if (seed == 0 && str.hash != 0) {
+      return str.hash;
+    }
+    return HashBytes(str.ptr, str.len, seed);
+  }
+
+  // IMPORTANT: Only use with literals!
+  // Length and hash are computed at compile time only when the call
+  // is constant-evaluated. As a plain argument, e.g. Button(ui, Lit("Ok")),
+  // it may hash at runtime on every call: use LIT there, which
+  // guarantees compile-time evaluation.
+  template <usize N>
+  constexpr String8 Lit(const char (&lit)[N]) {
+    return {
+      .ptr = lit,
+      .len = N - 1,
+      .hash = HashBytes(lit, N - 1),
+    };
+  }
+
+  #define LIT(lit) ([]() { constexpr core::String8 str = core::Lit(lit); return str; }())
 
   // Slotmap
   template <typename T>
@@ -229,28 +543,121 @@ namespace core {
       usize length{0};
       usize capacity{0};
       SlotMapNode<V>* nodes{nullptr};
+      // One bit per node, set while it holds a value,
+      // so iteration can skip free nodes without touching them
+      u64* occupied{nullptr};
       u32 next_free{0};
+      // Nodes on the free list
+      usize num_free{0};
+      // Where the buffers live: the heap when null, else the arenas.
+      // Growth extends a buffer in place when it is the arena's last
+      // allocation, and copies it otherwise: NewVirtualSlotMap gives
+      // each buffer its own arena, while with NewSlotMap the bitmap
+      // sits after the nodes, so the nodes are copied.
+      Arena* node_arena{nullptr};
+      Arena* occupancy_arena{nullptr};
+      // Set for NewVirtualSlotMap, whose arenas Free releases
+      bool owns_arenas{false};
+      // Most values the map can hold, 0 if unbounded
+      usize max_capacity{0};
   };
 
+  inline usize OccupancyWords(usize capacity) {
+    return (capacity + 63) / 64;
+  }
+
+  // A slotmap whose buffers live in the arena, released with it
+  template <typename K, typename V>
+  SlotMap<K, V> NewSlotMap(Arena* arena) {
+    return {
+      .node_arena = arena,
+      .occupancy_arena = arena,
+    };
+  }
+
+  // A slotmap that reserves address space for max_capacity values,
+  // one range per buffer, so growing never moves or copies nodes.
+  // Once full, Insert fails rather than growing past the range.
+  template <typename K, typename V>
+  SlotMap<K, V> NewVirtualSlotMap(usize max_capacity) {
+    auto node_arena = new Arena;
+    auto occupancy_arena = new Arena;
+    *node_arena = NewVirtualArena(sizeof(SlotMapNode<V>) * max_capacity);
+    *occupancy_arena = NewVirtualArena(sizeof(u64) * OccupancyWords(max_capacity));
+    return {
+      .node_arena = node_arena,
+      .occupancy_arena = occupancy_arena,
+      .owns_arenas = true,
+      .max_capacity = max_capacity,
+    };
+  }
+
+  // Grows a slotmap buffer, zeroing the new items
+  template <typename T>
+  T* GrowSlotMapBuffer(Arena* arena, T* buffer, usize old_len, usize new_len) {
+    auto old_bytes = sizeof(T) * old_len;
+    auto new_bytes = sizeof(T) * new_len;
+    T* grown = nullptr;
+    if (!arena) {
+      grown = (T*)malloc(new_bytes);
+    } else if (buffer && GrowInPlace(arena, (u8*)buffer, old_bytes, new_bytes)) {
+      grown = buffer;
+    } else {
+      grown = (T*)AllocBytes(arena, new_bytes, alignof(T));
+    }
+    assert(grown);
+    if (grown != buffer) {
+      if (buffer) {
+        memcpy((void*)grown, buffer, old_bytes);
+      }
+      if (!arena) {
+        free(buffer);
+      }
+    }
+    memset((void*)&grown[old_len], 0, new_bytes - old_bytes);
+    return grown;
+  }
+
+  // Grows to capacity, or as close as max_capacity allows
   template <typename K, typename V>
   void Grow(SlotMap<K, V>* sm, usize capacity) {
+    if (sm->max_capacity) {
+      capacity = Min(capacity, sm->max_capacity);
+    }
     if (capacity <= sm->capacity) {
       return;
     }
-    SlotMapNode<V>* nodes = (SlotMapNode<V>*)malloc(sizeof(SlotMapNode<V>) * capacity);
-    if (sm->nodes) {
-      memcpy(nodes, sm->nodes, sizeof(SlotMapNode<V>) * sm->capacity);
+    // Fresh nodes start at generation 0, and unoccupied
+    sm->nodes = GrowSlotMapBuffer(sm->node_arena, sm->nodes, sm->capacity, capacity);
+    sm->occupied = GrowSlotMapBuffer(sm->occupancy_arena, sm->occupied, OccupancyWords(sm->capacity), OccupancyWords(capacity));
+    sm->capacity = capacity;
+  }
+
+  // Releases the buffers, unless an arena passed to NewSlotMap owns them
+  template <typename K, typename V>
+  void Free(SlotMap<K, V>* sm) {
+    if (sm->owns_arenas) {
+      Free(sm->node_arena);
+      Free(sm->occupancy_arena);
+      delete sm->node_arena;
+      delete sm->occupancy_arena;
+    } else if (!sm->node_arena) {
       free(sm->nodes);
+      free(sm->occupied);
     }
-    sm->nodes = nodes;
-    sm->capacity = capacity;
+    *sm = {};
   }
 
+  // Returns a key with generation 0, which is never live, when the
+  // map is at its max_capacity
   template <typename K, typename V>
   K Insert(SlotMap<K, V>* sm, V value) {
     if (sm->next_free >= sm->capacity) {
       auto capacity = Max<usize>(sm->capacity * 2, 100);
       Grow(sm, capacity);
+      if (sm->next_free >= sm->capacity) {
+        return {};
+      }
     }
 
     bool is_new_alloc = sm->next_free == sm->length;
@@ -260,6 +667,7 @@ namespace core {
     node->generation += 1;
 
     K id = { .index = index, .generation = node->generation };
+    sm->occupied[index / 64] |= 1ull << (index % 64);
 
     if (is_new_alloc) {
       sm->next_free += 1;
@@ -267,12 +675,86 @@ namespace core {
       node->data = value;
     } else {
       sm->next_free = node->next_free;
+      sm->num_free -= 1;
       node->data = value;
     }
 
     return id;
   }
 
+  // Makes room for num_values live values, so inserting up to
+  // that many does not grow the map
+  template <typename K, typename V>
+  void Reserve(SlotMap<K, V>* sm, usize num_values) {
+    // Free nodes are reused first, so the nodes in use never
+    // exceed the larger of the two
+    Grow(sm, Max(num_values, sm->length));
+  }
+
+  template <typename K, typename V>
+  void SetOccupied(SlotMap<K, V>* sm, usize start, usize count) {
+    usize end = start + count;
+    while (start < end) {
+      usize bit = start % 64;
+      usize len = Min<usize>(64 - bit, end - start);
+      u64 mask = len == 64 ? ~0ull : ((1ull << len) - 1) << bit;
+      sm->occupied[start / 64] |= mask;
+      start += len;
+    }
+  }
+
+  // Inserts the values in order, appending their keys to keys.
+  // Grows at most once, then fills free nodes before fresh ones.
+  // Returns how many went in: fewer than num_values only when the
+  // map reached its max_capacity.
+  template <typename K, typename V>
+  usize InsertMany(SlotMap<K, V>* sm, const V* values, usize num_values, Array<K> keys) {
+    usize num_live = sm->length - sm->num_free;
+    if (num_live + num_values > sm->capacity) {
+      Grow(sm, Max(num_live + num_values, sm->capacity * 2));
+      num_values = Min(num_values, sm->capacity - num_live);
+    }
+    GrowToFit(keys, keys->len + num_values);
+    K* out = &keys->buffer[keys->len];
+    keys->len += num_values;
+
+    // The free list is a chain, so reusing it is serial
+    usize i = 0;
+    for (; i < num_values && sm->num_free > 0; ++i) {
+      u32 index = sm->next_free;
+      SlotMapNode<V>* node = &sm->nodes[index];
+      assert(node->generation % 2 == 0);
+      sm->next_free = node->next_free;
+      sm->num_free -= 1;
+      node->generation += 1;
+      node->data = values[i];
+      sm->occupied[index / 64] |= 1ull << (index % 64);
+      out[i] = { .index = index, .generation = node->generation };
+    }
+
+    // The rest go to fresh nodes at the end, in a straight loop
+    u32 start = sm->length;
+    usize num_fresh = num_values - i;
+    for (usize j = 0; j < num_fresh; ++j) {
+      SlotMapNode<V>* node = &sm->nodes[start + j];
+      node->generation = 1;
+      node->data = values[i + j];
+      out[i + j] = { .index = (u32)(start + j), .generation = 1 };
+    }
+    SetOccupied(sm, start, num_fresh);
+    sm->length += num_fresh;
+    if (num_fresh > 0) {
+      // The free list was used up
+      sm->next_free = sm->length;
+    }
+    return num_values;
+  }
+
+  template <typename K, typename V>
+  usize InsertMany(SlotMap<K, V>* sm, Array<V> values, Array<K> keys) {
+    return InsertMany(sm, values->buffer, values->len, keys);
+  }
+
   template <typename K, typename V>
   V* Get(SlotMap<K, V>* sm, K id) {
     if (id.index >= sm->length) {
@@ -302,11 +784,28 @@ namespace core {
 
     node->generation += 1;
     assert(node->generation % 2 == 0);
+    sm->occupied[id.index / 64] &= ~(1ull << (id.index % 64));
     node->next_free = sm->next_free;
     sm->next_free = id.index;
+    sm->num_free += 1;
     return true;
   }
 
+  // Returns how many of the keys were live
+  template <typename K, typename V>
+  usize RemoveMany(SlotMap<K, V>* sm, const K* keys, usize num_keys) {
+    usize removed = 0;
+    for (usize i = 0; i < num_keys; ++i) {
+      removed += Remove(sm, keys[i]);
+    }
+    return removed;
+  }
+
+  template <typename K, typename V>
+  usize RemoveMany(SlotMap<K, V>* sm, Array<K> keys) {
+    return RemoveMany(sm, keys->buffer, keys->len);
+  }
+
   template <typename K, typename V>
   struct SlotMapIter {
     SlotMap<K, V>* sm{nullptr};
@@ -334,21 +833,406 @@ namespace core {
 
   template <typename K, typename V>
   SlotMapEntry<K, V> Next(SlotMapIter<K, V>* iter) {
-    while (true) {
-      if (iter->idx >= iter->sm->length) {
+    auto sm = iter->sm;
+    if (iter->idx >= sm->length) {
+      return {};
+    }
+    // Find the next occupied node, a word of the bitmap at a time
+    usize word = iter->idx / 64;
+    usize num_words = OccupancyWords(sm->length);
+    u64 bits = sm->occupied[word] & (~0ull << (iter->idx % 64));
+    while (bits == 0) {
+      word++;
+      if (word >= num_words) {
+        iter->idx = sm->length;
         return {};
       }
-      SlotMapNode<V>* node = &iter->sm->nodes[iter->idx];
-      // If the node has some value...
-      if (node->generation % 2 == 1) {
-        K key = { .index = iter->idx, .generation = node->generation };
-        iter->idx++;
-        return { .key = key, .value = &node->data };
+      bits = sm->occupied[word];
+    }
+
+    u32 idx = word * 64 + __builtin_ctzll(bits);
+    SlotMapNode<V>* node = &sm->nodes[idx];
+    assert(node->generation % 2 == 1);
+    iter->idx = idx + 1;
+    K key = { .index = idx, .generation = node->generation };
+    return { .key = key, .value = &node->data };
+  }
+
+  // Range-for support: for (auto entry : &slotmap) { ... }
+  template <typename K, typename V>
+  struct SlotMapCursor {
+    SlotMapIter<K, V> iter;
+    SlotMapEntry<K, V> entry;
+
+    SlotMapEntry<K, V> operator*() const {
+      return this->entry;
+    }
+
+    SlotMapCursor& operator++() {
+      this->entry = Next(&this->iter);
+      return *this;
+    }
+
+    bool operator!=(const SlotMapCursor& other) const {
+      return this->entry.value != other.entry.value;
+    }
+  };
+
+  template <typename K, typename V>
+  SlotMapCursor<K, V> begin(SlotMap<K, V>* sm) {
+    SlotMapCursor<K, V> cursor = { .iter = Iter(sm), .entry = {} };
+    ++cursor;
+    return cursor;
+  }
+
+  template <typename K, typename V>
+  SlotMapCursor<K, V> end(SlotMap<K, V>*) {
+    return {};
+  }
+
+  // Dense slotmap: values are packed at the front of one array, so
+  // iterating is a linear scan over live values. Keys index a sparse
+  // array of slots pointing into the values; removal moves the last
+  // value into the hole.
+  struct DenseSlot {
+    // Odd while the slot is in use
+    u32 generation{0};
+    union {
+      u32 value_index;
+      u32 next_free;
+    };
+  };
+
+  template <typename K, typename V>
+  struct DenseSlotMap {
+    // Number of live values
+    usize length{0};
+    // Slots ever handed out, free ones included
+    usize num_slots{0};
+    usize capacity{0};
+    V* values{nullptr};
+    // For each value, the slot pointing to it
+    u32* value_slots{nullptr};
+    DenseSlot* slots{nullptr};
+    u32 next_free{0};
+  };
+
+  template <typename K, typename V>
+  void Grow(DenseSlotMap<K, V>* sm, usize capacity) {
+    if (capacity <= sm->capacity) {
+      return;
+    }
+    V* values = (V*)malloc(sizeof(V) * capacity);
+    u32* value_slots = (u32*)malloc(sizeof(u32) * capacity);
+    DenseSlot* slots = (DenseSlot*)malloc(sizeof(DenseSlot) * capacity);
+    if (sm->slots) {
+      memcpy(values, sm->values, sizeof(V) * sm->length);
+      memcpy(value_slots, sm->value_slots, sizeof(u32) * sm->length);
+      memcpy(slots, sm->slots, sizeof(DenseSlot) * sm->num_slots);
+      free(sm->values);
+      free(sm->value_slots);
+      free(sm->slots);
+    }
+    sm->values = values;
+    sm->value_slots = value_slots;
+    sm->slots = slots;
+    sm->capacity = capacity;
+  }
+
+  template <typename K, typename V>
+  void Free(DenseSlotMap<K, V>* sm) {
+    free(sm->values);
+    free(sm->value_slots);
+    free(sm->slots);
+    *sm = {};
+  }
+
+  template <typename K, typename V>
+  K Insert(DenseSlotMap<K, V>* sm, V value) {
+    // Every slot is in use exactly when the values are full
+    if (sm->length >= sm->capacity) {
+      auto capacity = Max<usize>(sm->capacity * 2, 100);
+      Grow(sm, capacity);
+    }
+
+    u32 slot_index = sm->next_free;
+    DenseSlot* slot = &sm->slots[slot_index];
+    if (slot_index == sm->num_slots) {
+      *slot = {};
+      sm->num_slots += 1;
+      sm->next_free += 1;
+    } else {
+      sm->next_free = slot->next_free;
+    }
+    assert(slot->generation % 2 == 0);
+    slot->generation += 1;
+
+    u32 value_index = sm->length;
+    slot->value_index = value_index;
+    sm->values[value_index] = value;
+    sm->value_slots[value_index] = slot_index;
+    sm->length += 1;
+
+    return { .index = slot_index, .generation = slot->generation };
+  }
+
+  template <typename K, typename V>
+  V* Get(DenseSlotMap<K, V>* sm, K id) {
+    if (id.index >= sm->num_slots) {
+      return nullptr;
+    }
+    DenseSlot* slot = &sm->slots[id.index];
+    if (slot->generation != id.generation) {
+      return nullptr;
+    }
+    return &sm->values[slot->value_index];
+  }
+
+  template <typename K, typename V>
+  bool Contains(DenseSlotMap<K, V>* sm, K id) {
+    return Get(sm, id) != nullptr;
+  }
+
+  template <typename K, typename V>
+  bool Remove(DenseSlotMap<K, V>* sm, K id) {
+    if (id.index >= sm->num_slots) {
+      return false;
+    }
+    DenseSlot* slot = &sm->slots[id.index];
+    if (slot->generation != id.generation) {
+      return false;
+    }
+
+    // Move the last value into the hole, and repoint its slot
+    u32 hole = slot->value_index;
+    u32 last = sm->length - 1;
+    if (hole != last) {
+      sm->values[hole] = sm->values[last];
+      sm->value_slots[hole] = sm->value_slots[last];
+      sm->slots[sm->value_slots[hole]].value_index = hole;
+    }
+    sm->length -= 1;
+
+    slot->generation += 1;
+    assert(slot->generation % 2 == 0);
+    slot->next_free = sm->next_free;
+    sm->next_free = id.index;
+    return true;
+  }
+
+  template <typename K, typename V>
+  struct DenseSlotMapIter {
+    DenseSlotMap<K, V>* sm{nullptr};
+    u32 idx{0};
+  };
+
+  // Visits values in storage order, which removals shuffle
+  template <typename K, typename V>
+  DenseSlotMapIter<K, V> Iter(DenseSlotMap<K, V>* sm) {
+    assert(sm);
+    return {
+      .sm = sm,
+      .idx = 0,
+    };
+  }
+
+  template <typename K, typename V>
+  SlotMapEntry<K, V> Next(DenseSlotMapIter<K, V>* iter) {
+    auto sm = iter->sm;
+    if (iter->idx >= sm->length) {
+      return {};
+    }
+    u32 slot_index = sm->value_slots[iter->idx];
+    K key = { .index = slot_index, .generation = sm->slots[slot_index].generation };
+    V* value = &sm->values[iter->idx];
+    iter->idx++;
+    return { .key = key, .value = value };
+  }
+
+  // Concurrent slotmap: any thread may insert, remove and read.
+  // Nodes live in segments that double in size and never move, so
+  // readers never see storage freed under them. Free nodes form a
+  // lock-free stack whose head is tagged against ABA.
+  const u32 CONCURRENT_SLOTMAP_BASE = 64;
+  const u32 CONCURRENT_SLOTMAP_SEGMENTS = 26;
+  const u32 CONCURRENT_SLOTMAP_NONE = std::numeric_limits<u32>::max();
+  // Words a node needs to hold a V
+  template <typename V>
+  constexpr usize CONCURRENT_SLOTMAP_WORDS = (sizeof(V) + 7) / 8;
+
+  template <typename V>
+  struct ConcurrentSlotMapNode {
+    // Odd while the node holds a value
+    std::atomic<u32> generation{0};
+    std::atomic<u32> next_free{CONCURRENT_SLOTMAP_NONE};
+    // The value, as words that readers may load while a writer
+    // replaces them; Get throws away what it read if so
+    std::atomic<u64> words[CONCURRENT_SLOTMAP_WORDS<V>]{};
+  };
+
+  template <typename K, typename V>
+  struct ConcurrentSlotMap {
+    // Segment k holds BASE << k nodes
+    std::atomic<ConcurrentSlotMapNode<V>*> segments[CONCURRENT_SLOTMAP_SEGMENTS]{};
+    // Nodes ever handed out
+    std::atomic<u32> num_slots{0};
+    // Free stack head: the tag in the high half, the index in the low one
+    std::atomic<u64> free_head{CONCURRENT_SLOTMAP_NONE};
+  };
+
+  inline u32 ConcurrentSegmentOf(u32 index, u32* offset) {
+    u64 block = (u64)index / CONCURRENT_SLOTMAP_BASE + 1;
+    u32 segment = 63 - __builtin_clzll(block);
+    *offset = index - CONCURRENT_SLOTMAP_BASE * ((1u << segment) - 1);
+    return segment;
+  }
+
+  // Null if the node's segment is not allocated yet
+  template <typename K, typename V>
+  ConcurrentSlotMapNode<V>* NodeAt(ConcurrentSlotMap<K, V>* sm, u32 index) {
+    u32 offset;
+    u32 segment = ConcurrentSegmentOf(index, &offset);
+    auto nodes = sm->segments[segment].load(std::memory_order_acquire);
+    return nodes ? &nodes[offset] : nullptr;
+  }
+
+  // Allocates the segment holding index, unless another thread did
+  template <typename K, typename V>
+  ConcurrentSlotMapNode<V>* EnsureNode(ConcurrentSlotMap<K, V>* sm, u32 index) {
+    u32 offset;
+    u32 segment = ConcurrentSegmentOf(index, &offset);
+    assert(segment < CONCURRENT_SLOTMAP_SEGMENTS);
+    auto nodes = sm->segments[segment].load(std::memory_order_acquire);
+    if (!nodes) {
+      usize len = (usize)CONCURRENT_SLOTMAP_BASE << segment;
+      auto fresh = (ConcurrentSlotMapNode<V>*)malloc(sizeof(ConcurrentSlotMapNode<V>) * len);
+      for (usize i = 0; i < len; ++i) {
+        new (&fresh[i]) ConcurrentSlotMapNode<V>{};
+      }
+      if (sm->segments[segment].compare_exchange_strong(nodes, fresh, std::memory_order_acq_rel)) {
+        nodes = fresh;
       } else {
-        // Just increment
-        iter->idx++;
+        // Lost the race, nodes now holds the winner's segment
+        free(fresh);
+      }
+    }
+    return &nodes[offset];
+  }
+
+  template <typename K, typename V>
+  void Free(ConcurrentSlotMap<K, V>* sm) {
+    for (auto& segment : sm->segments) {
+      free(segment.exchange(nullptr));
+    }
+    sm->num_slots = 0;
+    sm->free_head = CONCURRENT_SLOTMAP_NONE;
+  }
+
+  template <typename V>
+  void StoreValue(ConcurrentSlotMapNode<V>* node, const V& value) {
+    u64 words[CONCURRENT_SLOTMAP_WORDS<V>] = {};
+    memcpy(words, &value, sizeof(V));
+    for (usize i = 0; i < CONCURRENT_SLOTMAP_WORDS<V>; ++i) {
+      node->words[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  template <typename V>
+  void LoadValue(ConcurrentSlotMapNode<V>* node, V* out) {
+    u64 words[CONCURRENT_SLOTMAP_WORDS<V>];
+    for (usize i = 0; i < CONCURRENT_SLOTMAP_WORDS<V>; ++i) {
+      words[i] = node->words[i].load(std::memory_order_relaxed);
+    }
+    memcpy((void*)out, words, sizeof(V));
+  }
+
+  template <typename K, typename V>
+  K Insert(ConcurrentSlotMap<K, V>* sm, V value) {
+    static_assert(std::is_trivially_copyable_v<V>);
+    // Pop a free node, or take a fresh one
+    u32 index = CONCURRENT_SLOTMAP_NONE;
+    u64 head = sm->free_head.load(std::memory_order_acquire);
+    while ((u32)head != CONCURRENT_SLOTMAP_NONE) {
+      // A node on the stack was inserted once, so its segment exists;
+      // the check only spares GCC from warning about a null load
+      auto free_node = NodeAt(sm, (u32)head);
+      if (!free_node) { break; }
+      u32 next = free_node->next_free.load(std::memory_order_relaxed);
+      // Bumping the tag makes the exchange fail if the head was
+      // popped and pushed back since we read it
+      u64 tag = (head >> 32) + 1;
+      if (sm->free_head.compare_exchange_weak(head, tag << 32 | next, std::memory_order_acquire)) {
+        index = (u32)head;
+        break;
       }
     }
+    if (index == CONCURRENT_SLOTMAP_NONE) {
+      index = sm->num_slots.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto node = EnsureNode(sm, index);
+    // Orders the stores below after the Remove that freed the node,
+    // so a reader that sees any of them also sees the new generation
+    std::atomic_thread_fence(std::memory_order_release);
+    StoreValue(node, value);
+    u32 generation = node->generation.load(std::memory_order_relaxed) + 1;
+    assert(generation % 2 == 1);
+    // Publishes the value to readers
+    node->generation.store(generation, std::memory_order_release);
+    return { .index = index, .generation = generation };
+  }
+
+  // Copies the value out, so a concurrent Remove can never be observed
+  // half way. Wait-free: a value replaced during the copy is reported
+  // as missing, which it is. The copy goes through relaxed atomic
+  // loads, so racing with the writer is defined, and the fence with
+  // the generation recheck rejects any mix of old and new words.
+  template <typename K, typename V>
+  bool Get(ConcurrentSlotMap<K, V>* sm, K id, V* out) {
+    static_assert(std::is_trivially_copyable_v<V>);
+    if (id.index >= sm->num_slots.load(std::memory_order_acquire)) {
+      return false;
+    }
+    auto node = NodeAt(sm, id.index);
+    if (!node || node->generation.load(std::memory_order_acquire) != id.generation) {
+      return false;
+    }
+    LoadValue(node, out);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return node->generation.load(std::memory_order_relaxed) == id.generation;
+  }
+
+  template <typename K, typename V>
+  bool Contains(ConcurrentSlotMap<K, V>* sm, K id) {
+    if (id.index >= sm->num_slots.load(std::memory_order_acquire)) {
+      return false;
+    }
+    auto node = NodeAt(sm, id.index);
+    return node && node->generation.load(std::memory_order_acquire) == id.generation;
+  }
+
+  template <typename K, typename V>
+  bool Remove(ConcurrentSlotMap<K, V>* sm, K id) {
+    if (id.index >= sm->num_slots.load(std::memory_order_acquire)) {
+      return false;
+    }
+    auto node = NodeAt(sm, id.index);
+    if (!node) {
+      return false;
+    }
+    // Only one remover wins the generation bump
+    u32 generation = id.generation;
+    if (generation % 2 == 0 ||
+        !node->generation.compare_exchange_strong(generation, id.generation + 1, std::memory_order_acq_rel)) {
+      return false;
+    }
+
+    // Push the node onto the free stack
+    u64 head = sm->free_head.load(std::memory_order_relaxed);
+    do {
+      node->next_free.store((u32)head, std::memory_order_relaxed);
+    } while (!sm->free_head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | id.index, std::memory_order_release));
+    return true;
   }
 
   
@@ -2,7 +2,6 @@
 #define UI_H
 #include <core.h>
 #include <limits>
-#include <raylib/raylib.h>
 
 namespace ui {
   using namespace core;
@@ -61,50 +60,78 @@ namespace ui {
 
   const WidgetId NO_ID = { 0 };
 
-  struct Widget;
+  // Widgets are stored in UiCtx as parallel arrays, with one entry per
+  // widget in each, so that every pass only streams the parts it needs.
+  // A Widget is the index of its entries.
+  struct Widget {
+    u32 index{0};
+
+    bool operator==(const Widget& other) const;
+    bool operator!=(const Widget& other) const;
+  };
+
+  const Widget NO_WIDGET = { std::numeric_limits<u32>::max() };
 
   struct WidgetTree {
-    Widget* first_child{nullptr};
-    Widget* last_child{nullptr};
-    Widget* sibling{nullptr};
-    Widget* parent{nullptr};
+    Widget first_child{NO_WIDGET};
+    Widget last_child{NO_WIDGET};
+    Widget sibling{NO_WIDGET};
+    Widget parent{NO_WIDGET};
+  };
+
+  // What layout reads to size and place a widget
+  struct WidgetShape {
+    Size logical_size[2];
+    Vec2 growth_axis;
+    Vec2 offset;
+    WidgetTree tree;
   };
 
   struct Layout {
     f32 computed_size[2] = {0.0, 0.0};
     Rect bounds;
-    const char* text_string{""};
     Vec2 text_size;
   };
 
-  const Font DEFAULT_FONT = GetFontDefault();
+  struct WidgetPaint {
+    RGBA fill;
+    Stroke stroke;
+    f32 rounding{0.0};
+  };
+
+  // What input handling reads
+  struct WidgetBehavior {
+    WidgetId id;
+    bool draggable{false};
+    bool mouse_transparent{false};
+  };
+
+  // A font owned by the rendering backend, opaque to the ui.
+  // A null handle stands for the backend's default font.
+  struct FontInfo {
+    const void* handle{nullptr};
+    u16 base_size{10};
+  };
+
+  // A font registered with a UiCtx, see RegisterFont.
+  // Widgets and style stacks carry this, not the FontInfo.
+  // The zero font is the backend's default font.
+  struct Font {
+    u16 index{0};
+  };
 
   struct Text {
     String8 content;
-    Font font{0};
+    Font font;
     u16 size{18};
     RGBA color;
   };
 
-  struct Widget {
-    WidgetId id;
-    // Logical size
-    Vec2 offset;
-    bool draggable{false};
-    bool mouse_transparent{false};
-
-    Size logical_size[2];
-    Vec2 growth_axis;
-    // Paint
-    RGBA fill;
-    Stroke stroke;
-    f32 rounding{0.0};
-    // Text
-    Text text;
-    // Hierarchy
-    WidgetTree tree;
-    // Layout
-    Layout layout;
+  // Mouse state for the frame, filled in by the host before EndUi
+  struct MouseState {
+    Vec2 pos;
+    bool pressed{false};
+    bool down{false};
   };
 
   struct Input {
@@ -168,36 +195,198 @@ namespace ui {
     WidgetId id{NO_ID};
     Vec2 offset;
   };
+
+  struct WidgetCacheSlot {
+    u32 generation{0};
+    WidgetCache cache;
+  };
+
+  // Open-addressing (linear probing) table of widget caches.
+  // Slots from an older generation are empty, so clearing is O(1).
+  struct WidgetCacheMap {
+    usize len{0};
+    usize capacity{0};
+    u32 generation{1};
+    WidgetCacheSlot* slots{nullptr};
+  };
+  
+  enum class DrawCmdKind : u8 {
+    Rect,
+    RoundedRect,
+    Stroke,
+    RoundedStroke,
+    Text,
+    // Restrict the following commands to the bounds, until Unclip
+    Clip,
+    Unclip,
+  };
+
+  // A backend-agnostic draw command, emitted by EndUi
+  struct DrawCmd {
+    DrawCmdKind kind{DrawCmdKind::Rect};
+    RGBA color;
+    // For text, only the position is used
+    Rect bounds;
+    f32 rounding{0.0};
+    f32 thickness{0.0};
+    // Text runs: a NUL-terminated copy in the frame arena
+    const char* text{nullptr};
+    FontInfo font;
+    f32 text_size{0.0};
+    // Hash of everything above, to diff frames
+    u64 hash{0};
+  };
+
+  // What a draw command covered last frame
+  struct DrawnCmd {
+    u64 hash{0};
+    Rect bounds;
+  };
+
+  // Measures a run of text in pixels. Pluggable, so the ui
+  // can run without a rendering backend.
+  using MeasureTextFn = Vec2 (*)(void* user, FontInfo font, String8 text, f32 size);
+
+  struct TextMeasurer {
+    MeasureTextFn measure{nullptr};
+    void* user{nullptr};
+  };
+
+  // Stub measurer: every glyph is half as wide as it is tall
+  Vec2 MeasureMonospace(void* user, FontInfo font, String8 text, f32 size);
+
+  struct TextMetrics {
+    // Hash of (string, font, size), 0 for empty slots
+    u64 key{0};
+    Vec2 size;
+    u32 last_used_frame{0};
+  };
+
+  // Measured text sizes, kept across frames.
+  // Each key lives within a small window of slots from its home slot;
+  // when the window is full, the least recently used entry is evicted.
+  struct TextCache {
+    usize capacity{0};
+    TextMetrics* slots{nullptr};
+    u32 frame{0};
+    usize hits{0};
+    usize misses{0};
+  };
   
   struct UiCtx {
-    Arena arena{nullptr};
-    Array<Widget> widgets;
+    // Holds everything below; heap-allocated, so it outlives copies
+    Arena* arena{nullptr};
+    // Widget storage, see Widget
+    Array<WidgetBehavior> behaviors;
+    Array<WidgetShape> shapes;
+    Array<Layout> layouts;
+    Array<WidgetPaint> paints;
+    Array<Text> texts;
     // Cache is double-buffered:
     // we write into active cache and read
     // from inactive cache
-    Array<WidgetCache> write_cache;
-    Array<WidgetCache> read_cache;
+    WidgetCacheMap write_cache;
+    WidgetCacheMap read_cache;
+    TextCache text_cache;
+    // Registered fonts, indexed by Font
+    Array<FontInfo> fonts;
+    // Last frame's draw list, to find what changed
+    Array<DrawnCmd> drawn;
+    TextMeasurer measurer;
     Style style;
+    MouseState mouse;
     Input input;
+    // Set when the ui needs another frame soon, even without new input:
+    // while dragging, animating, or reacting to changed input.
+    // Hosts can block on input events while it is false.
+    bool needs_frame{true};
   };
 
   UiCtx NewCtx(usize num_widgets = 1024);
   void Destroy(UiCtx* ctx);
 
+  // Fonts live as long as the context, the backend font must outlive it
+  Font RegisterFont(UiCtx* ctx, FontInfo info);
+  FontInfo GetFontInfo(UiCtx* ctx, Font font);
+
+  // Ids of widgets made inside a scope are seeded with the scope's id
+  struct IdScope {
+    WidgetId id{NO_ID};
+    // The widget that opened the scope, popped with it by PopParent.
+    // NO_WIDGET for scopes pushed with PushId.
+    Widget owner{NO_WIDGET};
+  };
+
+  // Uniform grid over the bounds of hoverable widgets, for hit-testing.
+  // The cell at (col, row) has index c = row * cols + col, and holds the
+  // widget indices cell_items[cell_start[c]] .. cell_items[cell_start[c + 1] - 1],
+  // in creation order.
+  struct HitGrid {
+    Rect bounds;
+    f32 cell_size{0.0};
+    u32 cols{0};
+    u32 rows{0};
+    u32* cell_start{nullptr};
+    u32* cell_items{nullptr};
+  };
+
   struct Ui {
     UiCtx* ctx{nullptr};
     Arena* arena{nullptr};
-    Widget* active_parent{nullptr};
-    Array<Widget*> widgets;
+    Widget active_parent{NO_WIDGET};
     Style style;
     Array<NumPair> num_stack;
     Array<ColorPair> color_stack;
     Array<FontPair> font_stack;
+    Array<IdScope> id_stack;
+    // Built by EndUi after layout
+    HitGrid hit_grid;
+    // Filled in by EndUi, for the backend to render
+    Array<DrawCmd> draw_list;
+    // Whether draw_list differs from last frame's; if not,
+    // the host can skip drawing the frame altogether
+    bool changed{true};
+    // Areas that differ from last frame, for backends that
+    // keep their framebuffer around and can redraw parts of it
+    Array<Rect> dirty_rects;
   };
 
+  inline usize NumWidgets(Ui* ui) {
+    return ui->ctx->shapes->len;
+  }
+
+  inline WidgetBehavior* BehaviorOf(Ui* ui, Widget widget) {
+    return &ui->ctx->behaviors->buffer[widget.index];
+  }
+
+  inline WidgetShape* ShapeOf(Ui* ui, Widget widget) {
+    return &ui->ctx->shapes->buffer[widget.index];
+  }
+
+  inline Layout* LayoutOf(Ui* ui, Widget widget) {
+    return &ui->ctx->layouts->buffer[widget.index];
+  }
+
+  inline WidgetPaint* PaintOf(Ui* ui, Widget widget) {
+    return &ui->ctx->paints->buffer[widget.index];
+  }
+
+  inline Text* TextOf(Ui* ui, Widget widget) {
+    return &ui->ctx->texts->buffer[widget.index];
+  }
+
   Ui* BeginUi(UiCtx* ctx, Arena* arena, Rect bounds);
   void EndUi(Ui* ui);
 
+  // Sizes and places every widget; EndUi runs it first
+  void ComputeLayout(Ui* ui);
+
+  // Topmost hoverable widget at the point, using the layout from EndUi
+  WidgetId HitTest(Ui* ui, Vec2 point);
+
+  // Asks the host for another frame after this one
+  void RequestFrame(Ui* ui);
+
   // UI variable management
   void PushNumVar(Ui* ui, NumVar var, f32 value);
   void PopNumVar(Ui* ui);
@@ -208,8 +397,16 @@ namespace ui {
   void PushFontVar(Ui* ui, FontVar var, Font value);
   void PopFontVar(Ui* ui);
 
+  // Widget ids
+  // Labels follow the "##" convention: "Label##suffix" shows "Label" and
+  // hashes the whole string, "Label###id" shows "Label" and hashes "id".
+  WidgetId MakeId(Ui* ui, String8 label);
+  void PushId(Ui* ui, String8 label);
+  void PushId(Ui* ui, u64 value);
+  void PopId(Ui* ui);
+
   // Widgets
-  Widget* AddWidget(Ui* ui, WidgetId id = {0});
+  Widget AddWidget(Ui* ui, WidgetId id = {0});
 
   void PopParent(Ui* ui);
 
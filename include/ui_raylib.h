@@ -0,0 +1,35 @@
+#ifndef UI_RAYLIB_H
+#define UI_RAYLIB_H
+#include <ui.h>
+#include <raylib/raylib.h>
+
+// Raylib backend for the ui: text measurement, input and drawing
+namespace ui::raylib {
+  // A font file kept in memory, rasterized lazily at each pixel size
+  // it is measured or drawn at, so that text stays crisp at any size
+  struct FontFace;
+
+  // Reads a font file; the face lives in the arena
+  FontFace* LoadFace(Arena* arena, const char* path);
+  // Releases the file and the glyph atlases, but not the face itself
+  void UnloadFace(FontFace* face);
+
+  // Describes the face, to register with RegisterFont.
+  // The face must outlive the returned info.
+  FontInfo WrapFace(const FontFace* face, u16 base_size);
+
+  // Measures text with raylib instead of the monospace stub
+  void Attach(UiCtx* ctx);
+
+  // Feeds this frame's mouse state to the ui; call before EndUi
+  void PollInput(UiCtx* ctx);
+
+  // Polls input like PollInputEvents, but sleeps until some input
+  // event arrives or the timeout (in seconds) passes
+  void WaitForEvents(f64 timeout);
+
+  // Executes a draw list emitted by EndUi
+  void Render(Array<DrawCmd> draw_list);
+}
+
+#endif
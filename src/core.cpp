@@ -1,5 +1,7 @@
 #include <core.h>
 #include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
 
   namespace core {
   inline static
@@ -11,12 +13,45 @@
     }
   }
 
+  // Statistics
+  //
+  inline static
+  void RecordAlloc(Arena* arena, usize num_bytes) {
+#if CORE_ARENA_STATS
+    auto stats = &arena->stats;
+    stats->used_bytes += num_bytes;
+    stats->peak_bytes = Max(stats->peak_bytes, stats->used_bytes);
+    stats->num_allocs += 1;
+#endif
+  }
+
+  inline static
+  void RecordGrowth(Arena* arena, usize num_bytes, usize wasted_bytes) {
+#if CORE_ARENA_STATS
+    auto stats = &arena->stats;
+    stats->growths[stats->num_growths % ARENA_GROWTH_LOG_SIZE] = {
+      .num_bytes = num_bytes,
+      .used_bytes = stats->used_bytes,
+    };
+    stats->num_growths += 1;
+    stats->wasted_bytes += wasted_bytes;
+#endif
+  }
+
+  inline static
+  void RecordReset(Arena* arena) {
+#if CORE_ARENA_STATS
+    arena->stats.last_used_bytes = arena->stats.used_bytes;
+    arena->stats.used_bytes = 0;
+#endif
+  }
+
   inline static
   ArenaChunk* NewChunk(usize capacity) {
     // Allocate the chunk
     auto* chunk = new ArenaChunk;
+    // Chunks are not zeroed: callers that need it use AllocZeroBytes
     auto* buffer = new u8[capacity];
-    memset(buffer, 0, capacity);
     *chunk = {
       .capacity = capacity,
       .cursor = 0,
@@ -46,17 +81,141 @@
     return arena;
   }
 
+  // Virtual memory
+  //
+  inline static
+  usize CommitGranularity() {
+    static const usize granularity = Max((usize)sysconf(_SC_PAGESIZE), (usize)64 * 1024);
+    return granularity;
+  }
+
+  inline static
+  usize RoundUp(usize value, usize multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+  }
+
+  Arena NewVirtualArena(usize reserve, usize decommit_above) {
+    reserve = RoundUp(reserve, CommitGranularity());
+    void* base = mmap(nullptr, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    assert(base != MAP_FAILED);
+
+    auto* chunk = new ArenaChunk;
+    *chunk = {
+      .capacity = 0,
+      .cursor = 0,
+      .buffer = (u8*)base,
+      .next = nullptr,
+    };
 
-  u8* AllocBytes(Arena* arena, usize num_bytes) {
-    if (LastChunkFreeSpace(arena) < num_bytes) {
-      GrowArena(arena, Max(num_bytes, (usize)2048));
+    Arena arena;
+    arena.first = chunk;
+    arena.last = chunk;
+    arena.num_chunks = 1;
+    arena.reserved = reserve;
+    arena.decommit_above = RoundUp(decommit_above, CommitGranularity());
+    return arena;
+  }
+
+  // Commit enough pages to fit num_bytes more past the cursor
+  inline static
+  bool CommitVirtual(Arena* arena, usize num_bytes) {
+    auto chunk = arena->first;
+    auto target = RoundUp(chunk->cursor + num_bytes, CommitGranularity());
+    if (target > arena->reserved) {
+      return false;
+    }
+    auto status = mprotect(chunk->buffer + chunk->capacity, target - chunk->capacity, PROT_READ | PROT_WRITE);
+    if (status != 0) {
+      return false;
+    }
+    RecordGrowth(arena, target - chunk->capacity, 0);
+    chunk->capacity = target;
+    arena->capacity = target;
+    return true;
+  }
+
+  inline static
+  void DecommitVirtual(Arena* arena, usize keep) {
+    auto chunk = arena->first;
+    if (chunk->capacity <= keep) {
+      return;
     }
+    auto* start = chunk->buffer + keep;
+    auto length = chunk->capacity - keep;
+    madvise(start, length, MADV_DONTNEED);
+    mprotect(start, length, PROT_NONE);
+    chunk->capacity = keep;
+    arena->capacity = keep;
+  }
+
+  // Bytes to skip past the last chunk's cursor to reach the alignment
+  inline static
+  usize AlignPadding(Arena* arena, usize align) {
+    if (!arena->last) {
+      return 0;
+    }
+    auto address = (uintptr_t)(arena->last->buffer + arena->last->cursor);
+    return (align - (address & (align - 1))) & (align - 1);
+  }
+
+  u8* AllocBytes(Arena* arena, usize num_bytes, usize align) {
+    assert(align > 0 && (align & (align - 1)) == 0);
+    auto padding = AlignPadding(arena, align);
+    if (LastChunkFreeSpace(arena) < padding + num_bytes) {
+      if (arena->reserved) {
+        if (!CommitVirtual(arena, padding + num_bytes)) {
+          assert(false && "virtual arena out of reserved space");
+          return nullptr;
+        }
+      } else {
+        // Leave room to align within the fresh chunk
+        auto wasted = LastChunkFreeSpace(arena);
+        auto chunk_size = Max(num_bytes + align - 1, (usize)2048);
+        GrowArena(arena, chunk_size);
+        RecordGrowth(arena, chunk_size, wasted);
+        padding = AlignPadding(arena, align);
+      }
+    }
+    arena->last->cursor += padding;
     u8* buffer = arena->last->buffer + arena->last->cursor;
     arena->last->cursor += num_bytes;
+    RecordAlloc(arena, padding + num_bytes);
+    return buffer;
+  }
+
+  bool GrowInPlace(Arena* arena, u8* ptr, usize old_bytes, usize new_bytes) {
+    auto chunk = arena->last;
+    // Only the allocation right before the cursor can grow in place
+    if (!chunk || ptr + old_bytes != chunk->buffer + chunk->cursor) {
+      return false;
+    }
+    auto extra = new_bytes - old_bytes;
+    if (LastChunkFreeSpace(arena) < extra) {
+      if (!arena->reserved || !CommitVirtual(arena, extra)) {
+        return false;
+      }
+    }
+    chunk->cursor += extra;
+    RecordAlloc(arena, extra);
+    return true;
+  }
+
+  u8* AllocZeroBytes(Arena* arena, usize num_bytes, usize align) {
+    u8* buffer = AllocBytes(arena, num_bytes, align);
+    if (buffer) {
+      memset(buffer, 0, num_bytes);
+    }
     return buffer;
   }
 
   void Free(Arena* arena) {
+    if (arena->reserved) {
+      munmap(arena->first->buffer, arena->reserved);
+      delete arena->first;
+      ZeroOut(arena);
+      return;
+    }
+
     auto chunk = arena->first;
     while (chunk) {
       auto next = chunk->next;
@@ -69,29 +228,111 @@
   }
 
   void Reset(Arena* arena) {
-    if (arena->num_chunks == 0) { return; }
-    else if (arena->num_chunks == 1) {
+    RecordReset(arena);
+    if (arena->reserved) {
+      // Virtual arenas are contiguous: just rewind
       auto chunk = arena->first;
+      auto frame_peak = Max(arena->frame_peak, chunk->cursor);
+      arena->recent_peaks[arena->num_resets % ARENA_PEAK_WINDOW] = frame_peak;
+      arena->num_resets += 1;
+      arena->frame_peak = 0;
       chunk->cursor = 0;
-      memset(chunk->buffer, 0, chunk->capacity);
+      if (arena->decommit_above) {
+        usize recent_peak = 0;
+        for (auto peak : arena->recent_peaks) {
+          recent_peak = Max(recent_peak, peak);
+        }
+        // A quarter of headroom, so frames that grow a little past
+        // the peak do not commit and decommit the same pages
+        auto keep = RoundUp(recent_peak + recent_peak / 4, CommitGranularity());
+        DecommitVirtual(arena, Max(arena->decommit_above, keep));
+      }
+      return;
+    }
+    if (arena->num_chunks == 0) { return; }
+    else if (arena->num_chunks == 1) {
+      arena->first->cursor = 0;
     } else {
       // Free all chunks
       auto capacity = arena->capacity;
+#if CORE_ARENA_STATS
+      auto stats = arena->stats;
+#endif
       Free(arena);
       GrowArena(arena, capacity);
+#if CORE_ARENA_STATS
+      arena->stats = stats;
+#endif
     }
   }
 
-  // String8
-  // 
-  String8 Lit(const char* lit) {
-    usize len = strlen(lit);
+  ArenaTemp BeginTemp(Arena* arena) {
     return {
-      .ptr = lit,
-      .len = len,
+      .arena = arena,
+      .chunk = arena->last,
+      .cursor = arena->last ? arena->last->cursor : 0,
+#if CORE_ARENA_STATS
+      .used_bytes = arena->stats.used_bytes,
+#endif
     };
   }
 
+  void EndTemp(ArenaTemp temp) {
+    auto arena = temp.arena;
+    if (!temp.chunk) {
+      // The arena was empty when the save-point was taken
+      Free(arena);
+      return;
+    }
+
+    // Drop the chunks grown since the save-point
+    auto chunk = temp.chunk->next;
+    while (chunk) {
+      auto next = chunk->next;
+      arena->capacity -= chunk->capacity;
+      arena->num_chunks -= 1;
+      delete[] chunk->buffer;
+      delete chunk;
+      chunk = next;
+    }
+    temp.chunk->next = nullptr;
+    if (arena->reserved) {
+      // Reset only sees where the cursor ends, not what was rewound
+      arena->frame_peak = Max(arena->frame_peak, temp.chunk->cursor);
+    }
+    temp.chunk->cursor = temp.cursor;
+    arena->last = temp.chunk;
+#if CORE_ARENA_STATS
+    arena->stats.used_bytes = temp.used_bytes;
+#endif
+  }
+
+  struct ScratchArenas {
+    Arena arenas[2];
+
+    ~ScratchArenas() {
+      for (auto& arena : this->arenas) {
+        Free(&arena);
+      }
+    }
+  };
+
+  Arena* GetScratch(Arena* conflict) {
+    thread_local ScratchArenas scratch;
+    for (auto& arena : scratch.arenas) {
+      if (&arena == conflict) {
+        continue;
+      }
+      if (!arena.reserved) {
+        arena = NewVirtualArena(256 * 1024 * 1024, 1024 * 1024);
+      }
+      return &arena;
+    }
+    return nullptr;
+  }
+
+  // String8
+  // 
   std::ostream& operator<<(std::ostream& os, const String8& dt)
   {
     os << dt.ptr;
@@ -108,8 +349,8 @@
     }
 
     return {
-      .len = i,
-      .ptr = base.ptr
+      .ptr = base.ptr,
+      .len = i
     };
   }
 
@@ -123,19 +364,4 @@
     ptr[string.len] = '\0';
     return ptr;
   }
-
-  
-  u64 Hash(u64 x, u64 y) {
-    return x * 13 + y * 17;
-  }
-
-  u64 Hash(String8 str) {
-    u64 accum = 0;
-    for (int i = 0; i < str.len; ++i) {
-      char ch = str.ptr[i];
-      accum = Hash(accum, ch);
-    }
-    return accum;
-  }
 }
-
@@ -1,4 +1,5 @@
 #include "ui.h"
+#include "ui_raylib.h"
 #include <core.h>
 #include <ostream>
 #include <raylib/raylib.h>
@@ -9,11 +10,11 @@ using namespace core;
 static inline
 void BuildUi(ui::Ui* ui) {
     {
-      ui::Window(ui, Lit("Hello Window"));
+      ui::Window(ui, LIT("Hello Window"));
 
       ui::Space(ui);
 
-      ui::Header(ui, Lit("Window"));
+      ui::Header(ui, LIT("Window"));
 
       ui::Space(ui);
   
@@ -22,13 +23,13 @@ void BuildUi(ui::Ui* ui) {
 
         ui::Space(ui);
 
-        if (ui::Button(ui, Lit("Test 1"))) {
+        if (ui::Button(ui, LIT("Test 1"))) {
           std::cout << "Clicked" << std::endl;
         }
 
         ui::Space(ui);
 
-        if (ui::Button(ui, Lit("Test 2"))) {
+        if (ui::Button(ui, LIT("Test 2"))) {
           std::cout << "Clicked" << std::endl;
         }
 
@@ -63,14 +64,18 @@ T FromRawId(u64 raw) {
 }
 
 
+// Longest time to sleep between frames while idle, in seconds
+const f64 IDLE_TIMEOUT = 1.0;
+
 int main() {
   InitWindow(1600, 900, "Test");
   SetTargetFPS(60);
 
   SlotMap<Entity, EntityData> entities{0};
+  defer(Free(&entities));
 
-  auto e1 = Insert(&entities, { .name = Lit("Federico") });
-  auto e2 = Insert(&entities, { .name = Lit("Tianqi") });
+  auto e1 = Insert(&entities, { .name = LIT("Federico") });
+  auto e2 = Insert(&entities, { .name = LIT("Tianqi") });
   std::cout << "Name #1 " << Get(&entities, e1)->name << std::endl;
   std::cout << "Name #2 " << Get(&entities, e2)->name << std::endl;
   {
@@ -87,10 +92,14 @@ int main() {
   ui::UiCtx ui_ctx = ui::NewCtx();
   defer(Destroy(&ui_ctx));
 
-  Arena frame_arena;
+  Arena frame_arena = NewVirtualArena(64 * 1024 * 1024, 1024 * 1024);
   defer(Free(&frame_arena));
 
-  ui_ctx.style.fonts[(usize)ui::FontVar::DEFAULT_FONT] = LoadFontEx("assets/fonts/default.ttf", 28, nullptr, 0);
+  ui::raylib::Attach(&ui_ctx);
+
+  // Loaded into the context's arena, so it lives as long as the context
+  auto face = ui::raylib::LoadFace(ui_ctx.arena, "assets/fonts/default.ttf");
+  ui_ctx.style.fonts[(usize)ui::FontVar::DEFAULT_FONT] = ui::RegisterFont(&ui_ctx, ui::raylib::WrapFace(face, 28));
 
   while (!WindowShouldClose()) {
 
@@ -98,20 +107,35 @@ int main() {
       break;
     }
 
-    BeginDrawing();
-    BeginBlendMode(BLEND_ALPHA);
-    ClearBackground(RAYWHITE);
-
     auto ui = ui::BeginUi(&ui_ctx, &frame_arena, { 20.0, 20.0, 1600.0, 900.0 });
     BuildUi(ui);    
+    ui::raylib::PollInput(&ui_ctx);
     ui::EndUi(ui);
 
-    EndBlendMode();
-    EndDrawing();
+    if (ui->changed) {
+      BeginDrawing();
+      BeginBlendMode(BLEND_ALPHA);
+      ClearBackground(RAYWHITE);
+
+      ui::raylib::Render(ui->draw_list);
+
+      EndBlendMode();
+      EndDrawing();
+    } else if (ui_ctx.needs_frame) {
+      // The screen already shows this frame: skip drawing,
+      // but keep receiving input at the same pace
+      PollInputEvents();
+      WaitTime(1.0 / 60.0);
+    } else {
+      // Idle: sleep until there is input to react to
+      ui::raylib::WaitForEvents(IDLE_TIMEOUT);
+    }
 
     Reset(&frame_arena);
   }
 
+  // Atlases are GPU textures, so unload them while the window is open
+  ui::raylib::UnloadFace(face);
   CloseWindow();
   return 0;
 }
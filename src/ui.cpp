@@ -1,6 +1,7 @@
-#include "raylib/raylib.h"
 #include <core.h>
 #include <ui.h>
+#include <algorithm>
+#include <cmath>
 namespace ui {
   using namespace core;
 
@@ -12,6 +13,14 @@ namespace ui {
     return this->id != other.id;
   }
 
+  bool Widget::operator==(const Widget& other) const {
+    return this->index == other.index;
+  }
+
+  bool Widget::operator!=(const Widget& other) const {
+    return this->index != other.index;
+  }
+
   inline static
   Style DefaultStyle() {
     Style style;
@@ -43,7 +52,7 @@ namespace ui {
     }
 
     FontPair font_pairs[] = {
-      { FontVar::DEFAULT_FONT, GetFontDefault() },
+      { FontVar::DEFAULT_FONT, Font{} },
     };
 
     for (auto pair : font_pairs) {
@@ -53,51 +62,212 @@ namespace ui {
     return style;
   }
 
+  inline static
+  WidgetCacheMap NewCacheMap(Arena* arena, usize num_widgets) {
+    // Keep the load factor at or below 1/2, with a power-of-two capacity
+    usize capacity = 16;
+    while (capacity < num_widgets * 2) {
+      capacity *= 2;
+    }
+    auto slots = AllocZero<WidgetCacheSlot>(arena, capacity, CACHE_LINE_SIZE);
+    return {
+      .len = 0,
+      .capacity = capacity,
+      .generation = 1,
+      .slots = slots,
+    };
+  }
+
+  inline static
+  usize SlotOf(WidgetCacheMap* map, WidgetId id) {
+    // Fibonacci hashing spreads the bits of the id over the whole table
+    return (id.id * 0x9E3779B97F4A7C15ull) & (map->capacity - 1);
+  }
+
+  // Returns the slot holding the id, or the empty slot where it would go.
+  // Null only if the map is full and does not hold the id.
+  inline static
+  WidgetCacheSlot* Probe(WidgetCacheMap* map, WidgetId id) {
+    assert(id != NO_ID);
+    usize idx = SlotOf(map, id);
+    for (usize i = 0; i < map->capacity; ++i) {
+      auto slot = &map->slots[idx];
+      if (slot->generation != map->generation || slot->cache.id == id) {
+        return slot;
+      }
+      idx = (idx + 1) & (map->capacity - 1);
+    }
+    return nullptr;
+  }
+
+  // Rehashes the map into a larger one if it cannot fit num_widgets
+  inline static
+  void Reserve(Arena* arena, WidgetCacheMap* map, usize num_widgets) {
+    if (num_widgets * 2 <= map->capacity) {
+      return;
+    }
+    auto grown = NewCacheMap(arena, num_widgets);
+    for (usize i = 0; i < map->capacity; ++i) {
+      auto slot = &map->slots[i];
+      if (slot->generation == map->generation) {
+        *Probe(&grown, slot->cache.id) = { .generation = grown.generation, .cache = slot->cache };
+        grown.len++;
+      }
+    }
+    *map = grown;
+  }
+
+  inline static
+  void Clear(WidgetCacheMap* map) {
+    map->len = 0;
+    map->generation++;
+    // On wrap-around, stale slots could look live again
+    if (map->generation == 0) {
+      ZeroOut(map->slots, map->capacity);
+      map->generation = 1;
+    }
+  }
+
+  const usize TEXT_CACHE_WINDOW = 8;
+
+  inline static
+  TextCache NewTextCache(Arena* arena, usize num_widgets) {
+    usize capacity = 256;
+    while (capacity < num_widgets * 2) {
+      capacity *= 2;
+    }
+    return {
+      .capacity = capacity,
+      .slots = AllocZero<TextMetrics>(arena, capacity, CACHE_LINE_SIZE),
+    };
+  }
+
+  // Returns the cached entry for the key, or the slot to overwrite with it
+  inline static
+  TextMetrics* Probe(TextCache* cache, u64 key) {
+    auto mask = cache->capacity - 1;
+    auto home = (key * 0x9E3779B97F4A7C15ull) & mask;
+    TextMetrics* victim = nullptr;
+    for (usize i = 0; i < TEXT_CACHE_WINDOW; ++i) {
+      auto slot = &cache->slots[(home + i) & mask];
+      if (slot->key == key) {
+        return slot;
+      }
+      if (!victim || slot->last_used_frame < victim->last_used_frame) {
+        victim = slot;
+      }
+    }
+    return victim;
+  }
+
+  // Rebuilds the cache larger if it cannot hold num_widgets texts,
+  // keeping the entries
+  inline static
+  void Reserve(Arena* arena, TextCache* cache, usize num_widgets) {
+    if (num_widgets * 2 <= cache->capacity) {
+      return;
+    }
+    auto grown = NewTextCache(arena, num_widgets);
+    grown.frame = cache->frame;
+    grown.hits = cache->hits;
+    grown.misses = cache->misses;
+    for (usize i = 0; i < cache->capacity; ++i) {
+      auto slot = &cache->slots[i];
+      if (slot->key != 0) {
+        *Probe(&grown, slot->key) = *slot;
+      }
+    }
+    *cache = grown;
+  }
+
   UiCtx NewCtx(usize num_widgets) {
-    // Create a new arena that will hold the UICtx's data
-    Arena arena = NewArena(sizeof(Widget) * num_widgets);
-    auto widgets = NewEmptyArray<Widget>(&arena, num_widgets);
+    // Create a new arena that will hold the UICtx's data.
+    // Arrays point at it, so it lives on the heap, where copies of
+    // the context cannot move it.
+    Arena* arena = new Arena;
+    *arena = NewArena((sizeof(WidgetBehavior) + sizeof(WidgetShape) + sizeof(Layout) + sizeof(WidgetPaint) + sizeof(Text)) * num_widgets);
+    auto behaviors = NewGrowableArray<WidgetBehavior>(arena, num_widgets, CACHE_LINE_SIZE);
+    auto shapes = NewGrowableArray<WidgetShape>(arena, num_widgets, CACHE_LINE_SIZE);
+    auto layouts = NewGrowableArray<Layout>(arena, num_widgets, CACHE_LINE_SIZE);
+    auto paints = NewGrowableArray<WidgetPaint>(arena, num_widgets, CACHE_LINE_SIZE);
+    auto texts = NewGrowableArray<Text>(arena, num_widgets, CACHE_LINE_SIZE);
+    auto write_cache = NewCacheMap(arena, num_widgets);
+    auto read_cache = NewCacheMap(arena, num_widgets);
+    auto text_cache = NewTextCache(arena, num_widgets);
+    auto drawn = NewGrowableArray<DrawnCmd>(arena, num_widgets * 2);
+    auto fonts = NewGrowableArray<FontInfo>(arena);
+    // The zero font is the default one
+    Push(fonts, FontInfo{});
     return {
       .arena = arena,
-      .widgets = NewEmptyArray<Widget>(&arena, num_widgets),
-      .write_cache = NewEmptyArray<WidgetCache>(&arena, num_widgets),
-      .read_cache = NewEmptyArray<WidgetCache>(&arena, num_widgets),
+      .behaviors = behaviors,
+      .shapes = shapes,
+      .layouts = layouts,
+      .paints = paints,
+      .texts = texts,
+      .write_cache = write_cache,
+      .read_cache = read_cache,
+      .text_cache = text_cache,
+      .fonts = fonts,
+      .drawn = drawn,
+      .measurer = { .measure = MeasureMonospace },
       .style = DefaultStyle(),
     };
   }
 
   inline static
   WidgetCache  ReadCacheOf(UiCtx* ctx, WidgetId id) {
-    for (auto cache: ctx->read_cache) {
-      if (cache.id == id) {
-        return cache;
-      }
+    auto map = &ctx->read_cache;
+    auto slot = Probe(map, id);
+    if (slot && slot->generation == map->generation) {
+      return slot->cache;
     }
     return {0};
   }
 
   inline static
-  WidgetCache* WriteCacheOf(UiCtx* ctx, Widget* widget) {
+  WidgetCache* WriteCacheOf(UiCtx* ctx, WidgetId id, Vec2 offset) {
     // Get the write cache if present
-    for (usize i = 0; i < ctx->write_cache->len; ++i) {
-      auto cache = At(ctx->write_cache, i);
-      if (cache->id == widget->id) {
-        return cache;
-      }
+    auto map = &ctx->write_cache;
+    // More widgets than last frame may be cached: grow before the load
+    // factor passes 1/2, so probes stay short and always find a slot
+    Reserve(ctx->arena, map, map->len + 1);
+    auto slot = Probe(map, id);
+    assert(slot);
+    if (slot->generation == map->generation) {
+      return &slot->cache;
     }
 
     // Else construct and return it
-    auto cache = WidgetCache {
-      .id = widget->id,
-      .offset = widget->offset
+    slot->generation = map->generation;
+    slot->cache = WidgetCache {
+      .id = id,
+      .offset = offset
     };
-
-    Push(ctx->write_cache, cache);
-    return Last(ctx->write_cache);
+    map->len++;
+    return &slot->cache;
   }
 
   void Destroy(UiCtx* ctx) {
-    Free(&ctx->arena);
+    Free(ctx->arena);
+    delete ctx->arena;
+    ctx->arena = nullptr;
+  }
+
+  Font RegisterFont(UiCtx* ctx, FontInfo info) {
+    Font font = { (u16)ctx->fonts->len };
+    bool pushed = Push(ctx->fonts, info);
+    assert(pushed && ctx->fonts->len <= std::numeric_limits<u16>::max());
+    return font;
+  }
+
+  FontInfo GetFontInfo(UiCtx* ctx, Font font) {
+    assert(font.index < ctx->fonts->len);
+    return ctx->fonts->buffer[font.index];
+  }
+
+  Vec2 MeasureMonospace(void*, FontInfo, String8 text, f32 size) {
+    return { text.len * size * 0.5f, size };
   }
 
   RGBA NewRGB(u8 red, u8 green, u8 blue) {
@@ -109,11 +279,6 @@ namespace ui {
     return { rect.x, rect.y };
   }
 
-  static inline
-  Vector2 ToRay(Vec2 xy) {
-    return { xy.x, xy.y };
-  }
-
 
   Vec2& Vec2::operator+=(const Vec2& other) {
     *this = *this + other;
@@ -136,21 +301,6 @@ namespace ui {
     return { this->x - other.x, this->y - other.y };
   }
 
-  static inline
-  Rectangle ToRay(Rect rect) {
-    return { rect.x, rect.y, rect.w, rect.h };
-  }
-
-  static inline
-  Color ToRay(RGBA color) {
-    return { color.r, color.g, color.b, color.a };
-  }
-
-  static inline
-  Vec2 FromRay(Vector2 xy) {
-    return { xy.x, xy.y };
-  }
-
   static inline
   bool Contains(Rect rect, Vec2 point) {
     return
@@ -160,6 +310,22 @@ namespace ui {
       point.y <= rect.y + rect.h;
   }
 
+  static inline
+  bool Overlaps(Rect a, Rect b) {
+    return
+      a.x <= b.x + b.w && b.x <= a.x + a.w &&
+      a.y <= b.y + b.h && b.y <= a.y + a.h;
+  }
+
+  static inline
+  Rect Union(Rect a, Rect b) {
+    f32 x = std::min(a.x, b.x);
+    f32 y = std::min(a.y, b.y);
+    f32 right = std::max(a.x + a.w, b.x + b.w);
+    f32 bottom = std::max(a.y + a.h, b.y + b.h);
+    return { x, y, right - x, bottom - y };
+  }
+
   static inline
   Size PixelSize(f32 value) {
     return { .kind = SizeKind::Pixels, .value = value };
@@ -199,38 +365,51 @@ namespace ui {
 
 
   Ui* BeginUi(UiCtx* ctx, Arena* arena, Rect bounds) {
+    // Size the caches for as many widgets as the last frame built
+    auto num_widgets = ctx->shapes->len;
+    Reserve(ctx->arena, &ctx->write_cache, num_widgets);
+    Reserve(ctx->arena, &ctx->read_cache, num_widgets);
+    Reserve(ctx->arena, &ctx->text_cache, num_widgets);
+
     // Clear the current widgets
-    Clear(ctx->widgets);
+    Clear(ctx->behaviors);
+    Clear(ctx->shapes);
+    Clear(ctx->layouts);
+    Clear(ctx->paints);
+    Clear(ctx->texts);
+
+    ctx->text_cache.frame++;
+    ctx->needs_frame = false;
 
     // Flip active and inactive widget
-    Swap(ctx->write_cache, ctx->read_cache);
+    Swap(&ctx->write_cache, &ctx->read_cache);
     // Clear the write_cache
-    Clear(ctx->write_cache);
+    Clear(&ctx->write_cache);
 
     // Allocate he ui in the provided arena
     auto ui = Alloc<Ui>(arena);
 
     // Initialize
     *ui = {
-      .arena = arena,
       .ctx = ctx,
-      .active_parent = nullptr,
-      .widgets = NewEmptyArray<Widget*>(arena, ctx->widgets->capacity),
+      .arena = arena,
+      .active_parent = NO_WIDGET,
       .style = ctx->style,
-      .num_stack = NewEmptyArray<NumPair>(arena, 20),
-      .color_stack = NewEmptyArray<ColorPair>(arena, 20),
-      .font_stack = NewEmptyArray<FontPair>(arena, 10),
+      .num_stack = NewGrowableArray<NumPair>(arena),
+      .color_stack = NewGrowableArray<ColorPair>(arena),
+      .font_stack = NewGrowableArray<FontPair>(arena),
+      .id_stack = NewGrowableArray<IdScope>(arena),
+      .draw_list = NewGrowableArray<DrawCmd>(arena, ctx->shapes->capacity * 2),
+      .dirty_rects = NewGrowableArray<Rect>(arena),
     };
 
     // Create the first, root widget
-    auto root = Emplace(ctx->widgets, {});
-    assert(root);
-    root->offset = Corner(bounds);
-    SetPixelSize(root->logical_size, { bounds.w, bounds.h });
-
-    root->growth_axis.y = 1.0;
+    auto root = AddWidget(ui);
+    auto shape = ShapeOf(ui, root);
+    shape->offset = Corner(bounds);
+    SetPixelSize(shape->logical_size, { bounds.w, bounds.h });
 
-    Push(ui->widgets, root);
+    shape->growth_axis.y = 1.0;
 
     ui->active_parent = root;
     
@@ -243,11 +422,11 @@ namespace ui {
   };
   
   inline static
-  f32 ReduceChildrenComputedSize(Widget* parent, usize axis, ReductionOp op) {
+  f32 ReduceChildrenComputedSize(Ui* ui, Widget parent, usize axis, ReductionOp op) {
     f32 accum = 0;
-    auto child = parent->tree.first_child;
-    while(child) {
-      auto value = child->layout.computed_size[axis];          
+    auto child = ShapeOf(ui, parent)->tree.first_child;
+    while(child != NO_WIDGET) {
+      auto value = LayoutOf(ui, child)->computed_size[axis];          
       switch (op) {
         case ReductionOp::Sum:
           accum += value;
@@ -256,115 +435,233 @@ namespace ui {
           accum = Max(accum, value);
           break;
       }
-      child = child->tree.sibling;
+      child = ShapeOf(ui, child)->tree.sibling;
     }
     return accum;
   }
 
   inline static
-  void Layout(Ui* ui) {
-    // Reset all layouts
-    for (auto widget : ui->widgets) {
-      widget->layout = {0};
+  Vec2 MeasureWidgetText(Ui* ui, Text text) {
+    auto cache = &ui->ctx->text_cache;
+    auto style_key = Hash((u64)text.font.index, (u64)text.size);
+    auto key = Hash(Hash(text.content), style_key);
+    // 0 marks empty slots
+    key = key ? key : 1;
+
+    auto slot = Probe(cache, key);
+    if (slot->key == key) {
+      cache->hits++;
+      slot->last_used_frame = cache->frame;
+      return slot->size;
     }
+    cache->misses++;
 
-    // Process text
-    for (auto widget : ui->widgets) {
-      auto text = widget->text;
-      // Skip empty text
-      if (IsEmpty(text.content)) {
-        continue;
-      }
-      // Convert text to string
-      widget->layout.text_string = CStr(ui->arena, text.content);
-      // Cache text size
-      auto measure = MeasureTextEx(text.font, widget->layout.text_string, text.size, 1);
-      widget->layout.text_size = FromRay(measure);
+    auto measurer = ui->ctx->measurer;
+    auto font = GetFontInfo(ui->ctx, text.font);
+    auto measure = measurer.measure(measurer.user, font, text.content, text.size);
+
+    *slot = {
+      .key = key,
+      .size = measure,
+      .last_used_frame = cache->frame,
+    };
+    return measure;
+  }
+
+  // Sizes that depend only on the widget itself, or on its children
+  inline static
+  void ComputeBottomUpSizes(Ui* ui, Widget widget) {
+    auto shape = ShapeOf(ui, widget);
+    auto layout = LayoutOf(ui, widget);
+    *layout = {0};
+
+    auto text = TextOf(ui, widget);
+    if (!IsEmpty(text->content)) {
+      layout->text_size = MeasureWidgetText(ui, *text);
     }
-    
+
     for (int axis = 0; axis < 2; ++axis) {
-      // Self-contained sizes
-      for (auto widget : ui->widgets) {
-        auto logical_size = widget->logical_size[axis];
-        switch (logical_size.kind) {
-          case SizeKind::Pixels:
-            widget->layout.computed_size[axis] = logical_size.value;
-            break;
-          case ui::SizeKind::Text: {
-              auto text_size = widget->layout.text_size;
-              f32 value = axis == 0 ? text_size.x : text_size.y;
-              widget->layout.computed_size[axis] = value + 10.0;
-            }
-            break;
-          default:
-            continue;
-        }
+      auto logical_size = shape->logical_size[axis];
+      auto* computed = &layout->computed_size[axis];
+      switch (logical_size.kind) {
+        case SizeKind::Pixels:
+          *computed = logical_size.value;
+          break;
+        case SizeKind::Text: {
+            auto text_size = layout->text_size;
+            f32 value = axis == 0 ? text_size.x : text_size.y;
+            *computed = value + 10.0;
+          }
+          break;
+        case SizeKind::SumOfChildren:
+          *computed = ReduceChildrenComputedSize(ui, widget, axis, ReductionOp::Sum);
+          break;
+        case SizeKind::MaxOfChildren:
+          *computed = ReduceChildrenComputedSize(ui, widget, axis, ReductionOp::Max);
+          break;
+        case SizeKind::PercentOfParent:
+          // Resolved top-down, once the parent's size is known
+          break;
       }
+    }
+  }
 
-      // Child-dependent sizes
-      for (int i = ui->widgets->len - 1; i >= 0; --i) {
-        auto widget = Get(ui->widgets, i);
-        auto logical_size = widget->logical_size[axis];
-
-        ReductionOp op{ReductionOp::Sum};
-        switch (logical_size.kind) {
-          case SizeKind::SumOfChildren:
-            op = ReductionOp::Sum;
-            break;
-            case SizeKind::MaxOfChildren:
-            op = ReductionOp::Max;
-            break;
-          default:
-            continue;
+  // Resolves the children's parent-dependent sizes, then places them
+  inline static
+  void PlaceChildren(Ui* ui, Widget widget) {
+    auto shape = ShapeOf(ui, widget);
+    auto layout = LayoutOf(ui, widget);
+    // Create cursor for children placement
+    auto cursor = Corner(layout->bounds);
+    auto child = shape->tree.first_child;
+    while (child != NO_WIDGET) {
+      auto child_shape = ShapeOf(ui, child);
+      auto child_layout = LayoutOf(ui, child);
+      for (int axis = 0; axis < 2; ++axis) {
+        auto logical_size = child_shape->logical_size[axis];
+        if (logical_size.kind == SizeKind::PercentOfParent) {
+          auto parent_size = layout->computed_size[axis];
+          child_layout->computed_size[axis] = parent_size * logical_size.value;
         }
-        widget->layout.computed_size[axis] = ReduceChildrenComputedSize(widget, axis, op);
       }
+      auto* bounds = &child_layout->bounds;
+      bounds->x = cursor.x;
+      bounds->y = cursor.y;
+      bounds->w = child_layout->computed_size[0];
+      bounds->h = child_layout->computed_size[1];
+      cursor.x += bounds->w * shape->growth_axis.x;
+      cursor.y += bounds->h * shape->growth_axis.y;
+      child = child_shape->tree.sibling;
+    }
+  }
 
-      // Parent-dependent size
-      for (auto widget: ui->widgets) {
-        auto logical_size = widget->logical_size[axis];
+  // Widgets are stored in creation order, so parents always come before
+  // their children: a reverse sweep is a bottom-up traversal, and a
+  // forward sweep is a top-down one. Each widget is visited once per
+  // sweep, plus once by its parent in each.
+  void ComputeLayout(Ui* ui) {
+    auto num_widgets = (u32)NumWidgets(ui);
+    for (auto i = num_widgets; i > 0; --i) {
+      ComputeBottomUpSizes(ui, { i - 1 });
+    }
 
-        switch (logical_size.kind) {
-          case (SizeKind::PercentOfParent): {            
-              assert(widget->tree.parent);
-              auto parent_size = widget->tree.parent->layout.computed_size[axis];
-              widget->layout.computed_size[axis] = parent_size * logical_size.value;
-              break;
-          }
-          default:
-            continue;
+    // The root has no parent to size and place it
+    auto root = LayoutOf(ui, { 0 });
+    root->bounds.w = root->computed_size[0];
+    root->bounds.h = root->computed_size[1];
+
+    for (u32 i = 0; i < num_widgets; ++i) {
+      // Offset the widget
+      auto offset = ShapeOf(ui, { i })->offset;
+      auto bounds = &LayoutOf(ui, { i })->bounds;
+      bounds->x += offset.x;
+      bounds->y += offset.y;
+      PlaceChildren(ui, { i });
+    }
+  }
+
+  static inline
+  bool IsHoverable(WidgetBehavior* behavior) {
+    // We skip over no-id widgets, or those that are marked as mouse-transparent
+    return behavior->id != NO_ID && !behavior->mouse_transparent;
+  }
+
+  const f32 MIN_HIT_CELL_SIZE = 32.0;
+  const u32 MAX_HIT_GRID_DIM = 256;
+
+  static inline
+  u32 ClampCell(f32 value, u32 dim) {
+    if (value < 0) { return 0; }
+    return std::min((u32)value, dim - 1);
+  }
+
+  static inline
+  void BuildHitGrid(Ui* ui) {
+    auto grid = &ui->hit_grid;
+    *grid = {};
+
+    // Cover the bounds of every hoverable widget
+    auto behaviors = ui->ctx->behaviors;
+    auto layouts = ui->ctx->layouts;
+    usize num_hoverable = 0;
+    for (u32 idx = 0; idx < behaviors->len; ++idx) {
+      if (!IsHoverable(&behaviors->buffer[idx])) { continue; }
+      auto bounds = layouts->buffer[idx].bounds;
+      grid->bounds = num_hoverable == 0 ? bounds : Union(grid->bounds, bounds);
+      num_hoverable++;
+    }
+    if (num_hoverable == 0) {
+      return;
+    }
+
+    // Aim for about one cell per widget
+    auto area = grid->bounds.w * grid->bounds.h;
+    grid->cell_size = Max(std::sqrt(area / num_hoverable), MIN_HIT_CELL_SIZE);
+    grid->cell_size = Max(grid->cell_size, grid->bounds.w / MAX_HIT_GRID_DIM);
+    grid->cell_size = Max(grid->cell_size, grid->bounds.h / MAX_HIT_GRID_DIM);
+    grid->cols = (u32)(grid->bounds.w / grid->cell_size) + 1;
+    grid->rows = (u32)(grid->bounds.h / grid->cell_size) + 1;
+
+    auto num_cells = grid->cols * grid->rows;
+    grid->cell_start = AllocZero<u32>(ui->arena, num_cells + 1);
+
+    // Widgets are bucketed in two passes: count per cell, then fill
+    auto for_each_cell = [&](u32 idx, auto&& fn) {
+      auto bounds = layouts->buffer[idx].bounds;
+      auto x0 = ClampCell((bounds.x - grid->bounds.x) / grid->cell_size, grid->cols);
+      auto x1 = ClampCell((bounds.x + bounds.w - grid->bounds.x) / grid->cell_size, grid->cols);
+      auto y0 = ClampCell((bounds.y - grid->bounds.y) / grid->cell_size, grid->rows);
+      auto y1 = ClampCell((bounds.y + bounds.h - grid->bounds.y) / grid->cell_size, grid->rows);
+      for (auto row = y0; row <= y1; ++row) {
+        for (auto col = x0; col <= x1; ++col) {
+          fn(row * grid->cols + col);
         }
       }
+    };
+
+    for (u32 idx = 0; idx < behaviors->len; ++idx) {
+      if (!IsHoverable(&behaviors->buffer[idx])) { continue; }
+      for_each_cell(idx, [&](u32 cell) { grid->cell_start[cell + 1]++; });
+    }
+    for (u32 cell = 0; cell < num_cells; ++cell) {
+      grid->cell_start[cell + 1] += grid->cell_start[cell];
     }
 
-    // Set all sizes
-    for (auto widget : ui->widgets) {
-      auto* bounds = &widget->layout.bounds;
-      bounds->w = widget->layout.computed_size[0];
-      bounds->h = widget->layout.computed_size[1];
+    grid->cell_items = Alloc<u32>(ui->arena, grid->cell_start[num_cells]);
+    // Fill cursors: reuse the starts, shifted back down by one cell afterwards
+    for (u32 idx = 0; idx < behaviors->len; ++idx) {
+      if (!IsHoverable(&behaviors->buffer[idx])) { continue; }
+      for_each_cell(idx, [&](u32 cell) { grid->cell_items[grid->cell_start[cell]++] = idx; });
+    }
+    for (u32 cell = num_cells; cell > 0; --cell) {
+      grid->cell_start[cell] = grid->cell_start[cell - 1];
     }
+    grid->cell_start[0] = 0;
+  }
 
-    // Placement
-    for (auto widget : ui->widgets) {
-      // Offset the widget
-      widget->layout.bounds.x += widget->offset.x;
-      widget->layout.bounds.y += widget->offset.y;
-      // Create cursor for children placement
-      auto cursor = Corner(widget->layout.bounds);
-      auto child = widget->tree.first_child;
-      while (child) {
-        child->layout.bounds.x = cursor.x;
-        child->layout.bounds.y = cursor.y;
-        cursor.x +=  child->layout.bounds.w * widget->growth_axis.x;
-        cursor.y += child->layout.bounds.h * widget->growth_axis.y;
-        child = child->tree.sibling;
+  WidgetId HitTest(Ui* ui, Vec2 point) {
+    auto grid = &ui->hit_grid;
+    if (grid->cols == 0 || !Contains(grid->bounds, point)) {
+      return NO_ID;
+    }
+    auto col = ClampCell((point.x - grid->bounds.x) / grid->cell_size, grid->cols);
+    auto row = ClampCell((point.y - grid->bounds.y) / grid->cell_size, grid->rows);
+    auto cell = row * grid->cols + col;
+
+    // Later widgets are drawn on top, so scan the cell backwards
+    for (auto i = grid->cell_start[cell + 1]; i > grid->cell_start[cell]; --i) {
+      Widget widget = { grid->cell_items[i - 1] };
+      if (Contains(LayoutOf(ui, widget)->bounds, point)) {
+        return BehaviorOf(ui, widget)->id;
       }
     }
+    return NO_ID;
   }
 
   static inline
   void ProcessInput(Ui* ui) {
-    auto mouse_pos = FromRay(GetMousePosition());
+    auto mouse = ui->ctx->mouse;
+    auto mouse_pos = mouse.pos;
     // Find top widget that is hovered
     Input* old_input = &ui->ctx->input;
     Input input;
@@ -372,20 +669,10 @@ namespace ui {
     input.mouse_pos = mouse_pos;
     input.mouse_prev_pos = old_input->mouse_pos;
 
-    for (int idx = ui->widgets->len - 1; idx >= 0; --idx) {
-      auto widget = Get(ui->widgets, idx);
-      if (widget->id == NO_ID || widget->mouse_transparent) {
-        // We skip over no-id widgets, or those that are marked as mouse-transparent
-        continue;
-      }
-      if (Contains(widget->layout.bounds, mouse_pos)) {
-        input.hovered_id = widget->id;
-        break;
-      }
-    }
+    input.hovered_id = HitTest(ui, mouse_pos);
     if (input.hovered_id != NO_ID) {
-      input.click = IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
-      input.hold = IsMouseButtonDown(MOUSE_LEFT_BUTTON);
+      input.click = mouse.pressed;
+      input.hold = mouse.down;
     }
     
     // If we are holding now, and were not holding before,
@@ -400,93 +687,231 @@ namespace ui {
       input.hold_start_pos = {0};
     }
     
+    // Widgets read the input on the next frame, so they need one to react
+    bool input_changed =
+      input.hovered_id != old_input->hovered_id ||
+      input.click != old_input->click ||
+      input.hold != old_input->hold;
+    if (input_changed) {
+      RequestFrame(ui);
+    }
+    
     ui->ctx->input = input;
   }
 
   static inline
   void Drag(Ui* ui) {
     // For each draggable widget...
-    for (auto widget : ui->widgets) {
+    auto behaviors = ui->ctx->behaviors;
+    for (u32 idx = 0; idx < behaviors->len; ++idx) {
+      auto behavior = &behaviors->buffer[idx];
 
       bool candidate =
         // We care about draggable widgets
-        widget->draggable &&
+        behavior->draggable &&
         // With an id
-        widget->id != NO_ID;
+        behavior->id != NO_ID;
 
       if (!candidate) {
         continue;
       }
       
       // Find the widget's cache, and update the recorded position
-      auto cache = WriteCacheOf(ui->ctx, widget);
-      cache->offset = widget->offset;
+      auto offset = ShapeOf(ui, { idx })->offset;
+      auto cache = WriteCacheOf(ui->ctx, behavior->id, offset);
+      cache->offset = offset;
 
       // If we are hold_and_drag this widget, update the offset
-      if (ui->ctx->input.hold && ui->ctx->input.hovered_id == widget->id) {
+      if (ui->ctx->input.hold && ui->ctx->input.hovered_id == behavior->id) {
         // Get the delta-mouse movement
         auto delta_mouse = ui->ctx->input.mouse_pos - ui->ctx->input.mouse_prev_pos;
         cache->offset += delta_mouse;
+        // Keep tracking the mouse while the drag lasts
+        RequestFrame(ui);
       }
     };
   }
 
   static inline
-  void Draw(Ui* ui) {
-    for (auto widget : ui->widgets) {
-      auto bounds = ToRay(widget->layout.bounds);
-      const auto NUM_SEGMENTS = 4;
-      
-      if (widget->fill.a != 0) {
-        auto color = ToRay(widget->fill);
-        if (widget->rounding <= 0.0) {
-          DrawRectangle(bounds.x, bounds.y, bounds.width, bounds.height, color);
-        } else {
-          DrawRectangleRounded(bounds, widget->rounding, NUM_SEGMENTS, color);
-        }
+  u64 HashBits(f32 value) {
+    u32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  static inline
+  u64 HashRect(u64 seed, Rect rect) {
+    seed = Hash(seed, HashBits(rect.x) | HashBits(rect.y) << 32);
+    return Hash(seed, HashBits(rect.w) | HashBits(rect.h) << 32);
+  }
+
+  // Hashes the command, with text_hash standing in for the text pointer
+  static inline
+  u64 HashDrawCmd(DrawCmd* cmd, u64 text_hash) {
+    auto color = cmd->color;
+    u64 seed = Hash((u64)cmd->kind, (u64)color.r | color.g << 8 | color.b << 16 | (u64)color.a << 24);
+    seed = HashRect(seed, cmd->bounds);
+    seed = Hash(seed, HashBits(cmd->rounding) | HashBits(cmd->thickness) << 32);
+    seed = Hash(seed, (u64)(uintptr_t)cmd->font.handle);
+    return Hash(seed, Hash(text_hash, HashBits(cmd->text_size)));
+  }
+
+  static inline
+  void PushDrawCmd(Ui* ui, DrawCmd cmd, u64 text_hash = 0) {
+    cmd.hash = HashDrawCmd(&cmd, text_hash);
+    Push(ui->draw_list, cmd);
+  }
+
+  const usize MAX_DIRTY_RECTS = 16;
+
+  static inline
+  void AddDirtyRect(Ui* ui, DrawnCmd cmd) {
+    auto rect = cmd.bounds;
+    if (rect.w <= 0 && rect.h <= 0) {
+      return;
+    }
+    auto dirty = ui->dirty_rects;
+    // Merge into the first overlapping rect
+    for (auto& other : dirty) {
+      if (Overlaps(other, rect)) {
+        other = Union(other, rect);
+        return;
       }
+    }
+    // Past the limit, collapse everything into a single rect
+    if (dirty->len >= MAX_DIRTY_RECTS) {
+      for (usize i = 1; i < dirty->len; ++i) {
+        dirty->buffer[0] = Union(dirty->buffer[0], dirty->buffer[i]);
+      }
+      dirty->buffer[0] = Union(dirty->buffer[0], rect);
+      dirty->len = 1;
+      return;
+    }
+    Push(dirty, rect);
+  }
 
-      auto thickness = widget->stroke.thickness;
-      if (thickness > 0 && widget->stroke.color.a != 0) {
-        auto color = ToRay(widget->stroke.color);
-        if (widget->rounding <= 0.0) {
-          DrawRectangleLinesEx(bounds, thickness, color);
+  // Compares the draw list with last frame's, command by command,
+  // and remembers it for the next frame
+  static inline
+  void DiffDrawList(Ui* ui) {
+    auto drawn = ui->ctx->drawn;
+    auto draw_list = ui->draw_list;
+    auto len = Max(drawn->len, draw_list->len);
+
+    ui->changed = drawn->len != draw_list->len;
+    for (usize i = 0; i < len; ++i) {
+      auto before = i < drawn->len ? drawn->buffer[i] : DrawnCmd{};
+      DrawnCmd after = {};
+      if (i < draw_list->len) {
+        auto cmd = &draw_list->buffer[i];
+        // Strokes may spill over the bounds
+        auto pad = cmd->thickness;
+        after = {
+          .hash = cmd->hash,
+          .bounds = { cmd->bounds.x - pad, cmd->bounds.y - pad, cmd->bounds.w + 2 * pad, cmd->bounds.h + 2 * pad },
+        };
+      }
+      if (before.hash != after.hash) {
+        ui->changed = true;
+        AddDirtyRect(ui, before);
+        AddDirtyRect(ui, after);
+      }
+      if (i < draw_list->len) {
+        if (i < drawn->len) {
+          drawn->buffer[i] = after;
         } else {
-          DrawRectangleRoundedLinesEx(bounds, widget->rounding, NUM_SEGMENTS, thickness, color);
+          Push(drawn, after);
         }
       }
+    }
+    drawn->len = draw_list->len;
+  }
 
-      auto text = widget->text;
+  static inline
+  void EmitDrawList(Ui* ui) {
+    auto layouts = ui->ctx->layouts;
+    auto paints = ui->ctx->paints;
+    auto texts = ui->ctx->texts;
+    PushDrawCmd(ui, { .kind = DrawCmdKind::Clip, .bounds = layouts->buffer[0].bounds });
+
+    for (usize idx = 0; idx < layouts->len; ++idx) {
+      auto layout = &layouts->buffer[idx];
+      auto paint = &paints->buffer[idx];
+      auto bounds = layout->bounds;
+      bool rounded = paint->rounding > 0.0;
+
+      if (paint->fill.a != 0) {
+        PushDrawCmd(ui, {
+          .kind = rounded ? DrawCmdKind::RoundedRect : DrawCmdKind::Rect,
+          .color = paint->fill,
+          .bounds = bounds,
+          .rounding = paint->rounding,
+        });
+      }
+
+      auto stroke = paint->stroke;
+      if (stroke.thickness > 0 && stroke.color.a != 0) {
+        PushDrawCmd(ui, {
+          .kind = rounded ? DrawCmdKind::RoundedStroke : DrawCmdKind::Stroke,
+          .color = stroke.color,
+          .bounds = bounds,
+          .rounding = paint->rounding,
+          .thickness = stroke.thickness,
+        });
+      }
+
+      auto text = texts->buffer[idx];
       if (!IsEmpty(text.content)) {
-        auto bounds = widget->layout.bounds;
-        auto pos = Corner(bounds);
-        pos.x += (bounds.w - widget->layout.text_size.x)/2.0;
-        pos.y += (bounds.h - widget->layout.text_size.y)/2.0;
-        auto color = ToRay(text.color);
-        DrawTextEx(text.font, widget->layout.text_string, ToRay(pos), text.size, 1, color);
+        // Center the text in the widget
+        auto text_size = layout->text_size;
+        Rect text_bounds = {
+          .x = bounds.x + (bounds.w - text_size.x) / 2.0f,
+          .y = bounds.y + (bounds.h - text_size.y) / 2.0f,
+          .w = text_size.x,
+          .h = text_size.y,
+        };
+        PushDrawCmd(ui, {
+          .kind = DrawCmdKind::Text,
+          .color = text.color,
+          .bounds = text_bounds,
+          .text = CStr(ui->arena, text.content),
+          .font = GetFontInfo(ui->ctx, text.font),
+          .text_size = (f32)text.size,
+        }, Hash(text.content));
       }
     }
+
+    PushDrawCmd(ui, { .kind = DrawCmdKind::Unclip });
+  }
+
+  void RequestFrame(Ui* ui) {
+    ui->ctx->needs_frame = true;
   }
 
   void EndUi(Ui* ui) {
-    Layout(ui);    
+    ComputeLayout(ui);
+
+    BuildHitGrid(ui);
 
     ProcessInput(ui);
 
     Drag(ui);
 
-    Draw(ui);
+    EmitDrawList(ui);
+
+    DiffDrawList(ui);
   }
 
   static inline
-  void PushChild(Widget* parent, Widget* child) {
-    if(!parent->tree.last_child) {
-      parent->tree.first_child = child;
+  void PushChild(Ui* ui, Widget parent, Widget child) {
+    auto tree = &ShapeOf(ui, parent)->tree;
+    if(tree->last_child == NO_WIDGET) {
+      tree->first_child = child;
     } else {
-      parent->tree.last_child->tree.sibling = child;
+      ShapeOf(ui, tree->last_child)->tree.sibling = child;
     }
-    parent->tree.last_child = child;
-    child->tree.parent = parent;
+    tree->last_child = child;
+    ShapeOf(ui, child)->tree.parent = parent;
   }
 
   void PushNumVar(Ui* ui, NumVar var, f32 value) {
@@ -543,28 +968,103 @@ namespace ui {
     };
   }
 
-  void PopParent(Ui* ui) {
-    auto* next = ui->active_parent->tree.parent;
-    assert(next);
-    ui->active_parent = next;
+  // Index of the first "##" in the text, or its length if there is none
+  static inline
+  usize FindIdSeparator(String8 text) {
+    for (usize i = 0; i + 1 < text.len; ++i) {
+      if (text.ptr[i] == '#' && text.ptr[i + 1] == '#') {
+        return i;
+      }
+    }
+    return text.len;
+  }
+
+  // The part of a label that is shown, before any "##"
+  static inline
+  String8 DisplayText(String8 label) {
+    auto separator = FindIdSeparator(label);
+    if (separator == label.len) {
+      // Keep any precomputed hash
+      return label;
+    }
+    return { .ptr = label.ptr, .len = separator };
+  }
+
+  // The part of a label that is hashed into the id
+  static inline
+  String8 IdText(String8 label) {
+    auto separator = FindIdSeparator(label);
+    if (separator + 2 < label.len && label.ptr[separator + 2] == '#') {
+      // "###": only what follows identifies the widget
+      auto start = separator + 3;
+      return { .ptr = label.ptr + start, .len = label.len - start };
+    }
+    return label;
   }
 
-  Widget* AddWidget(Ui* ui, WidgetId id) {
-    auto widget = Emplace(ui->ctx->widgets, {0});
-    assert(widget);
+  static inline
+  u64 IdSeed(Ui* ui) {
+    if (auto scope = Last(ui->id_stack)) {
+      return scope->id.id;
+    }
+    return 0;
+  }
+
+  WidgetId MakeId(Ui* ui, String8 label) {
+    return { Hash(IdSeed(ui), Hash(IdText(label))) };
+  }
+
+  static inline
+  void PushIdScope(Ui* ui, WidgetId id, Widget owner) {
+    Push(ui->id_stack, { .id = id, .owner = owner });
+  }
+
+  void PushId(Ui* ui, String8 label) {
+    PushIdScope(ui, MakeId(ui, label), NO_WIDGET);
+  }
+
+  void PushId(Ui* ui, u64 value) {
+    PushIdScope(ui, { Hash(IdSeed(ui), value) }, NO_WIDGET);
+  }
+
+  void PopId(Ui* ui) {
+    Pop(ui->id_stack);
+  }
 
-    widget->id = id;
+  void PopParent(Ui* ui) {
+    // Close the id scope opened by the parent, if any
+    auto scope = Last(ui->id_stack);
+    if (scope && scope->owner == ui->active_parent) {
+      PopId(ui);
+    }
 
-    bool added = Push(ui->widgets, widget);
+    auto next = ShapeOf(ui, ui->active_parent)->tree.parent;
+    assert(next != NO_WIDGET);
+    ui->active_parent = next;
+  }
+
+  Widget AddWidget(Ui* ui, WidgetId id) {
+    auto ctx = ui->ctx;
+    Widget widget = { (u32)ctx->shapes->len };
+    // The arrays are growable, so these only fail on out of memory
+    bool added =
+      Push(ctx->behaviors, { .id = id }) &&
+      Push(ctx->shapes, {}) &&
+      Push(ctx->layouts, {}) &&
+      Push(ctx->paints, {}) &&
+      Push(ctx->texts, {});
     assert(added);
 
-    PushChild(ui->active_parent, widget);
+    // Only the root has no parent
+    if (ui->active_parent != NO_WIDGET) {
+      PushChild(ui, ui->active_parent, widget);
+    }
 
     return widget;
   }
 
   void Space(Ui* ui, SpaceKind kind, f32 multiplier) {
-    auto gw_axis = ui->active_parent->growth_axis;
+    auto gw_axis = ShapeOf(ui, ui->active_parent)->growth_axis;
 
     switch (kind) {
       case ui::SpaceKind::InLine:
@@ -576,29 +1076,29 @@ namespace ui {
     
     Vec2 size = GetStyleVar(ui, NumVar::SPACER_WIDTH, NumVar::SPACER_HEIGHT) * gw_axis * multiplier;
     auto widget = AddWidget(ui);
-    SetPixelSize(widget->logical_size, size);
+    SetPixelSize(ShapeOf(ui, widget)->logical_size, size);
   }
 
   static inline
   Text WidgetText(Ui* ui, String8 text) {
     auto font = GetStyleVar(ui, FontVar::DEFAULT_FONT); 
     return {
-      .content = text,
-      .color = NewRGB(0, 0, 0),
+      .content = DisplayText(text),
       .font = font,
-      .size = (u16)font.baseSize,
+      .size = GetFontInfo(ui->ctx, font).base_size,
+      .color = NewRGB(0, 0, 0),
     };
   }
 
   bool Button(Ui* ui, String8 text) {
-    WidgetId id = { Hash(SubstringUntil(text, '#')) };
+    WidgetId id = MakeId(ui, text);
     auto interaction = InteractionFor(ui, id);
 
     auto widget = AddWidget(ui, id);
 
-    widget->text = WidgetText(ui, text);
+    *TextOf(ui, widget) = WidgetText(ui, text);
     
-    SetPixelSize(widget->logical_size, GetStyleVar(ui, NumVar::ITEM_WIDTH, NumVar::ITEM_HEIGHT));
+    SetPixelSize(ShapeOf(ui, widget)->logical_size, GetStyleVar(ui, NumVar::ITEM_WIDTH, NumVar::ITEM_HEIGHT));
 
     auto stroke_color = ColorVar::ITEM_STROKE;
 
@@ -608,60 +1108,64 @@ namespace ui {
       stroke_color = ColorVar::ITEM_STROKE_HIGHLIGHT;
     }
 
-    widget->rounding = GetStyleVar(ui, NumVar::ITEM_ROUNDING);
+    auto paint = PaintOf(ui, widget);
+    paint->rounding = GetStyleVar(ui, NumVar::ITEM_ROUNDING);
     
-    widget->fill = GetStyleVar(ui, ColorVar::ITEM_FILL);
-    widget->stroke = { GetStyleVar(ui, stroke_color), GetStyleVar(ui, NumVar::ITEM_THICK),};
+    paint->fill = GetStyleVar(ui, ColorVar::ITEM_FILL);
+    paint->stroke = { GetStyleVar(ui, stroke_color), GetStyleVar(ui, NumVar::ITEM_THICK),};
 
     return interaction.is_clicked;
   }
 
   void Label(Ui* ui, String8 text) {
     auto widget = AddWidget(ui);
-    widget->text = WidgetText(ui, text);
+    *TextOf(ui, widget) = WidgetText(ui, text);
 
-    widget->logical_size[0].kind = SizeKind::Text;
-    widget->logical_size[1].kind = SizeKind::Text;
+    auto shape = ShapeOf(ui, widget);
+    shape->logical_size[0].kind = SizeKind::Text;
+    shape->logical_size[1].kind = SizeKind::Text;
   }
 
   void Header(Ui* ui, String8 text) {
     auto widget = AddWidget(ui);
-    widget->text = WidgetText(ui, text);
+    *TextOf(ui, widget) = WidgetText(ui, text);
 
-    widget->logical_size[0] = { SizeKind::PercentOfParent, 1.0 };
-    widget->logical_size[1] = { SizeKind::Pixels, GetStyleVar(ui, NumVar::ITEM_HEIGHT) };
+    auto shape = ShapeOf(ui, widget);
+    shape->logical_size[0] = { SizeKind::PercentOfParent, 1.0 };
+    shape->logical_size[1] = { SizeKind::Pixels, GetStyleVar(ui, NumVar::ITEM_HEIGHT) };
   }
 
-  Widget* BaseList(Ui* ui) {
-    auto* widget = AddWidget(ui);
+  Widget BaseList(Ui* ui) {
+    auto widget = AddWidget(ui);
 
-    widget->fill = GetStyleVar(ui, ColorVar::LIST_FILL);
+    auto paint = PaintOf(ui, widget);
+    paint->fill = GetStyleVar(ui, ColorVar::LIST_FILL);
 
-    widget->stroke = {
-      .thickness = GetStyleVar(ui, NumVar::LIST_THICK),
+    paint->stroke = {
       .color = GetStyleVar(ui, ColorVar::LIST_STROKE),
+      .thickness = GetStyleVar(ui, NumVar::LIST_THICK),
     };
 
-    assert(widget->tree.parent);
+    assert(ShapeOf(ui, widget)->tree.parent != NO_WIDGET);
     ui->active_parent = widget;
     return widget;
   }
   
   void HList(Ui* ui) {
-    auto widget = BaseList(ui);
-    widget->growth_axis.x = 1.0;
+    auto shape = ShapeOf(ui, BaseList(ui));
+    shape->growth_axis.x = 1.0;
 
-    widget->logical_size[0] = { .kind = SizeKind::SumOfChildren };
-    widget->logical_size[1] = { .kind = SizeKind::MaxOfChildren };
+    shape->logical_size[0] = { .kind = SizeKind::SumOfChildren };
+    shape->logical_size[1] = { .kind = SizeKind::MaxOfChildren };
   }
 
   void VList(Ui* ui) {
-    auto widget = BaseList(ui);
+    auto shape = ShapeOf(ui, BaseList(ui));
 
-    widget->growth_axis.y = 1.0;
+    shape->growth_axis.y = 1.0;
 
-    widget->logical_size[0] = { .kind = SizeKind::MaxOfChildren };
-    widget->logical_size[1] = { .kind = SizeKind::SumOfChildren };
+    shape->logical_size[0] = { .kind = SizeKind::MaxOfChildren };
+    shape->logical_size[1] = { .kind = SizeKind::SumOfChildren };
   }
 
   void Window(Ui* ui, String8 id_source) {
@@ -671,11 +1175,14 @@ namespace ui {
       ui::VList(ui);
 
       auto widget = ui->active_parent;
-      widget->id = { Hash(SubstringUntil(id_source, '#')) };
-      auto cache = ReadCacheOf(ui->ctx, widget->id);
-
-      widget->offset = cache.offset;
-      widget->draggable = true;
+      auto behavior = BehaviorOf(ui, widget);
+      behavior->id = MakeId(ui, id_source);
+      auto cache = ReadCacheOf(ui->ctx, behavior->id);
+      // Widgets inside the window are scoped by its id
+      PushIdScope(ui, behavior->id, widget);
+
+      ShapeOf(ui, widget)->offset = cache.offset;
+      behavior->draggable = true;
 
       ui::PopColorVar(ui);
       ui::PopNumVar(ui);
@@ -0,0 +1,200 @@
+#include <core.h>
+#include <ui.h>
+#include <ui_raylib.h>
+#include <raylib/rlgl.h>
+#include <GLFW/glfw3.h>
+#include <cmath>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace ui::raylib {
+  using namespace core;
+
+  static inline
+  Vector2 ToRay(Vec2 xy) {
+    return { xy.x, xy.y };
+  }
+
+  static inline
+  Rectangle ToRay(Rect rect) {
+    return { rect.x, rect.y, rect.w, rect.h };
+  }
+
+  static inline
+  Color ToRay(RGBA color) {
+    return { color.r, color.g, color.b, color.a };
+  }
+
+  // Faces keep a few sizes rasterized, evicting the least recently used
+  const usize MAX_FACE_SIZES = 8;
+
+  struct SizedFont {
+    // 0 for empty slots
+    u16 size{0};
+    ::Font font;
+    u64 last_used{0};
+  };
+
+  struct FontFace {
+    unsigned char* data{nullptr};
+    int data_size{0};
+    // File extension, which raylib uses to pick a loader
+    char file_type[16];
+    SizedFont sizes[MAX_FACE_SIZES];
+    u64 clock{0};
+  };
+
+  FontFace* LoadFace(Arena* arena, const char* path) {
+    auto face = Alloc<FontFace>(arena);
+    *face = {};
+    face->data = LoadFileData(path, &face->data_size);
+    assert(face->data);
+    auto extension = GetFileExtension(path);
+    assert(extension && strlen(extension) < sizeof(face->file_type));
+    strcpy(face->file_type, extension);
+    return face;
+  }
+
+  void UnloadFace(FontFace* face) {
+    for (auto& sized : face->sizes) {
+      if (sized.size != 0) {
+        UnloadFont(sized.font);
+      }
+    }
+    UnloadFileData(face->data);
+    *face = {};
+  }
+
+  FontInfo WrapFace(const FontFace* face, u16 base_size) {
+    return {
+      .handle = face,
+      .base_size = base_size,
+    };
+  }
+
+  // The face rasterized at the given size, loaded on first use
+  static
+  ::Font FontAtSize(FontFace* face, f32 size) {
+    u16 pixels = (u16)Max(std::lround(size), 1l);
+    face->clock++;
+
+    SizedFont* victim = &face->sizes[0];
+    for (auto& sized : face->sizes) {
+      if (sized.size == pixels) {
+        sized.last_used = face->clock;
+        return sized.font;
+      }
+      if (sized.last_used < victim->last_used) {
+        victim = &sized;
+      }
+    }
+
+    if (victim->size != 0) {
+      // Pending draws may still sample the evicted atlas
+      rlDrawRenderBatchActive();
+      UnloadFont(victim->font);
+    }
+    *victim = {
+      .size = pixels,
+      .font = LoadFontFromMemory(face->file_type, face->data, face->data_size, pixels, nullptr, 0),
+      .last_used = face->clock,
+    };
+    return victim->font;
+  }
+
+  static inline
+  ::Font ToRay(FontInfo font, f32 size) {
+    if (!font.handle) {
+      return GetFontDefault();
+    }
+    // Faces are only mutated through their size cache
+    return FontAtSize((FontFace*)font.handle, size);
+  }
+
+  static inline
+  Vec2 FromRay(Vector2 xy) {
+    return { xy.x, xy.y };
+  }
+
+  static
+  Vec2 MeasureText(void* user, FontInfo font, String8 text, f32 size) {
+    // Raylib wants a C string
+    temp_scope(temp, GetScratch());
+    auto text_string = CStr(temp.arena, text);
+    return FromRay(MeasureTextEx(ToRay(font, size), text_string, size, 1));
+  }
+
+  void Attach(UiCtx* ctx) {
+    ctx->measurer = { .measure = MeasureText };
+  }
+
+  void PollInput(UiCtx* ctx) {
+    ctx->mouse = {
+      .pos = FromRay(GetMousePosition()),
+      .pressed = IsMouseButtonPressed(MOUSE_LEFT_BUTTON),
+      .down = IsMouseButtonDown(MOUSE_LEFT_BUTTON),
+    };
+  }
+
+  void WaitForEvents(f64 timeout) {
+    // Raylib can only wait without a timeout, so a waker thread
+    // posts an empty event once the timeout passes
+    std::mutex mutex;
+    std::condition_variable woken;
+    bool done = false;
+
+    std::thread waker([&]() {
+      std::unique_lock<std::mutex> lock(mutex);
+      auto duration = std::chrono::duration<f64>(timeout);
+      if (!woken.wait_for(lock, duration, [&]() { return done; })) {
+        glfwPostEmptyEvent();
+      }
+    });
+
+    EnableEventWaiting();
+    PollInputEvents();
+    DisableEventWaiting();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+    }
+    woken.notify_one();
+    waker.join();
+  }
+
+  void Render(Array<DrawCmd> draw_list) {
+    const auto NUM_SEGMENTS = 4;
+
+    for (auto& cmd : draw_list) {
+      auto bounds = ToRay(cmd.bounds);
+      auto color = ToRay(cmd.color);
+
+      switch (cmd.kind) {
+        case DrawCmdKind::Rect:
+          DrawRectangle(bounds.x, bounds.y, bounds.width, bounds.height, color);
+          break;
+        case DrawCmdKind::RoundedRect:
+          DrawRectangleRounded(bounds, cmd.rounding, NUM_SEGMENTS, color);
+          break;
+        case DrawCmdKind::Stroke:
+          DrawRectangleLinesEx(bounds, cmd.thickness, color);
+          break;
+        case DrawCmdKind::RoundedStroke:
+          DrawRectangleRoundedLinesEx(bounds, cmd.rounding, NUM_SEGMENTS, cmd.thickness, color);
+          break;
+        case DrawCmdKind::Text:
+          DrawTextEx(ToRay(cmd.font, cmd.text_size), cmd.text, { bounds.x, bounds.y }, cmd.text_size, 1, color);
+          break;
+        case DrawCmdKind::Clip:
+          BeginScissorMode(bounds.x, bounds.y, bounds.width, bounds.height);
+          break;
+        case DrawCmdKind::Unclip:
+          EndScissorMode();
+          break;
+      }
+    }
+  }
+}
@@ -0,0 +1,123 @@
+// Alignment of arena allocations, across chunk boundaries
+#include <core.h>
+#include "check.h"
+
+using namespace core;
+
+static
+bool IsAligned(const void* ptr, usize align) {
+  return (uintptr_t)ptr % align == 0;
+}
+
+struct alignas(32) Vec8 {
+  f32 lanes[8];
+};
+
+// Odd-sized allocations between aligned ones, in chunks small enough
+// that many allocations land at the start of a fresh chunk
+static
+void CheckAlignment(Arena* arena) {
+  const usize aligns[] = { 1, 2, 4, 8, 16, 32, 64, 128, 4096 };
+  for (usize i = 0; i < 2000; ++i) {
+    usize odd = i % 13 + 1;
+    auto bytes = AllocBytes(arena, odd);
+    CHECK(bytes);
+    // Bytes are usable right up to the end
+    memset(bytes, 0xAB, odd);
+
+    auto align = aligns[i % (sizeof(aligns) / sizeof(aligns[0]))];
+    auto aligned = AllocBytes(arena, 24, align);
+    CHECK(aligned && IsAligned(aligned, align));
+    CHECK(aligned >= bytes + odd || aligned + 24 <= bytes);
+    memset(aligned, 0xCD, 24);
+    CHECK(bytes[odd - 1] == 0xAB);
+
+    auto words = Alloc<u64>(arena, 3);
+    CHECK(IsAligned(words, alignof(u64)));
+    auto vec = Alloc<Vec8>(arena);
+    CHECK(IsAligned(vec, alignof(Vec8)));
+    auto line = AllocCacheAligned<u32>(arena, 5);
+    CHECK(IsAligned(line, CACHE_LINE_SIZE));
+    auto zeroed = AllocZero<u16>(arena, 7, 16);
+    CHECK(IsAligned(zeroed, 16));
+    for (usize j = 0; j < 7; ++j) {
+      CHECK(zeroed[j] == 0);
+    }
+  }
+}
+
+static
+void TestChunkedArena() {
+  Arena arena = NewArena(100);
+  CheckAlignment(&arena);
+  CHECK(arena.num_chunks > 1);
+
+  // Alignment still holds once the chunks are coalesced by Reset
+  Reset(&arena);
+  CheckAlignment(&arena);
+  Free(&arena);
+}
+
+static
+void TestVirtualArena() {
+  Arena arena = NewVirtualArena(64 * 1024 * 1024);
+  CheckAlignment(&arena);
+  Reset(&arena);
+  CheckAlignment(&arena);
+  Free(&arena);
+}
+
+// Frames that use more than decommit_above keep their pages, and
+// a spike is decommitted once it leaves the window of recent frames
+static
+void TestDecommitAboveRecentPeak() {
+  const usize MB = 1024 * 1024;
+  Arena arena = NewVirtualArena(64 * MB, MB);
+  for (usize frame = 0; frame < 3; ++frame) {
+    CHECK(AllocBytes(&arena, 4 * MB));
+    Reset(&arena);
+    CHECK(arena.capacity >= 4 * MB);
+  }
+  auto capacity = arena.capacity;
+  // Use within the kept pages commits nothing new
+  CHECK(AllocBytes(&arena, 4 * MB));
+  CHECK(arena.capacity == capacity);
+
+  // Peaks rewound by a temp scope count too
+  {
+    temp_scope(temp, &arena);
+    CHECK(AllocBytes(&arena, 8 * MB));
+  }
+  Reset(&arena);
+  CHECK(arena.capacity >= 8 * MB);
+
+  for (usize frame = 0; frame < ARENA_PEAK_WINDOW; ++frame) {
+    CHECK(AllocBytes(&arena, 100));
+    Reset(&arena);
+  }
+  CHECK(arena.capacity == arena.decommit_above);
+  Free(&arena);
+}
+
+static
+void TestTempScopes() {
+  Arena arena = NewArena(64);
+  AllocBytes(&arena, 3);
+  {
+    temp_scope(temp, &arena);
+    for (usize i = 0; i < 100; ++i) {
+      AllocBytes(temp.arena, 7);
+      CHECK(IsAligned(AllocCacheAligned<u8>(temp.arena, 1), CACHE_LINE_SIZE));
+    }
+  }
+  CHECK(IsAligned(Alloc<u64>(&arena), alignof(u64)));
+  Free(&arena);
+}
+
+int main() {
+  TestChunkedArena();
+  TestVirtualArena();
+  TestDecommitAboveRecentPeak();
+  TestTempScopes();
+  return 0;
+}
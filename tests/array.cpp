@@ -0,0 +1,67 @@
+// Growable arrays with items that are not trivially copyable
+#include <core.h>
+#include "check.h"
+
+using namespace core;
+
+static int num_live = 0;
+
+struct Tracked {
+  int value{0};
+
+  Tracked() { num_live++; }
+  Tracked(int value) : value(value) { num_live++; }
+  Tracked(const Tracked& other) : value(other.value) { num_live++; }
+  Tracked(Tracked&& other) : value(other.value) { num_live++; }
+  ~Tracked() { num_live--; }
+};
+
+static
+void TestResize() {
+  Arena arena = NewArena(64);
+  {
+    auto array = NewGrowableArray<Tracked>(&arena, 2);
+    for (int i = 0; i < 100; ++i) {
+      CHECK(Push(array, Tracked(i)));
+    }
+    // Growth moves the items and destroys the old ones
+    CHECK(num_live == 100);
+    for (int i = 0; i < 100; ++i) {
+      CHECK(array->buffer[i].value == i);
+    }
+
+    Resize(array, 10);
+    CHECK(num_live == 10);
+    Resize(array, 20);
+    CHECK(num_live == 20);
+    CHECK(array->buffer[9].value == 9);
+    CHECK(array->buffer[19].value == 0);
+    CHECK(Pop(array).value == 0);
+    CHECK(num_live == 19);
+    Clear(array);
+    CHECK(num_live == 0);
+  }
+  Free(&arena);
+}
+
+static
+void TestGrowthKeepsAlignment() {
+  Arena arena = NewArena(4096);
+  auto array = NewGrowableArray<u32>(&arena, 3, CACHE_LINE_SIZE);
+  auto buffer = array->buffer;
+  // Something after the buffer, so it cannot grow in place
+  AllocBytes(&arena, 1);
+  for (u32 i = 0; i < 100; ++i) {
+    CHECK(Push(array, i));
+  }
+  CHECK(array->buffer != buffer);
+  CHECK((uintptr_t)array->buffer % CACHE_LINE_SIZE == 0);
+  CHECK(array->buffer[99] == 99);
+  Free(&arena);
+}
+
+int main() {
+  TestResize();
+  TestGrowthKeepsAlignment();
+  return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef CHECK_H
+#define CHECK_H
+#include <cstdio>
+#include <cstdlib>
+
+// Like assert, but also checked in release builds
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      std::exit(1); \
+    } \
+  } while (0)
+
+#endif
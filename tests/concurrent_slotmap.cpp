@@ -0,0 +1,129 @@
+// ConcurrentSlotMap under writers that insert, remove and race each
+// other's removes, while a reader copies values out
+#include <core.h>
+#include <thread>
+#include "check.h"
+
+using namespace core;
+
+MAKE_SLOTMAP_KEY(Entity);
+
+// Three words that agree with each other, so a torn copy shows
+struct Payload {
+  u64 a;
+  u64 b;
+  u64 c;
+};
+
+static
+Payload MakePayload(u64 x) {
+  return { .a = x, .b = x * 0x9E3779B97F4A7C15ull, .c = ~x };
+}
+
+static
+bool IsWhole(Payload payload) {
+  return payload.b == payload.a * 0x9E3779B97F4A7C15ull && payload.c == ~payload.a;
+}
+
+static
+u64 ToRaw(Entity id) {
+  return (u64)id.index << 32 | id.generation;
+}
+
+static
+Entity FromRaw(u64 raw) {
+  return { .index = (u32)(raw >> 32), .generation = (u32)raw };
+}
+
+static
+u64 NextRandom(u64* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+const usize NUM_WRITERS = 4;
+const usize NUM_OPS = 100000;
+const usize NUM_PUBLISHED = 256;
+
+static ConcurrentSlotMap<Entity, Payload> map;
+// Keys the writers share; 0 is empty, since generation 0 is never live
+static std::atomic<u64> published[NUM_PUBLISHED];
+static std::atomic<usize> num_removed{0};
+static std::atomic<bool> done{false};
+
+static
+void TryRemove(u64 raw) {
+  if (raw && Remove(&map, FromRaw(raw))) {
+    num_removed.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+static
+void Write(u64 thread) {
+  u64 rng = thread + 1;
+  for (u64 i = 0; i < NUM_OPS; ++i) {
+    auto payload = MakePayload(thread << 32 | i);
+    auto id = Insert(&map, payload);
+    // Nobody else knows the key yet, so the node must be ours alone
+    Payload out;
+    CHECK(Get(&map, id, &out));
+    CHECK(out.a == payload.a && IsWhole(out));
+
+    // Publish it, and remove whatever it displaced
+    auto slot = NextRandom(&rng) % NUM_PUBLISHED;
+    TryRemove(published[slot].exchange(ToRaw(id)));
+    // Race the owner of another key to remove it
+    TryRemove(published[NextRandom(&rng) % NUM_PUBLISHED].load());
+  }
+}
+
+static
+void Read() {
+  u64 rng = 99;
+  usize num_found = 0;
+  while (!done.load()) {
+    auto raw = published[NextRandom(&rng) % NUM_PUBLISHED].load();
+    Payload out;
+    if (raw && Get(&map, FromRaw(raw), &out)) {
+      CHECK(IsWhole(out));
+      num_found++;
+    }
+  }
+  CHECK(num_found > 0);
+}
+
+int main() {
+  std::thread reader(Read);
+  std::thread writers[NUM_WRITERS];
+  for (usize i = 0; i < NUM_WRITERS; ++i) {
+    writers[i] = std::thread(Write, i);
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+
+  for (auto& slot : published) {
+    TryRemove(slot.exchange(0));
+  }
+  // Every key was removed exactly once
+  CHECK(num_removed == NUM_WRITERS * NUM_OPS);
+
+  // And every node is back on the free stack, once
+  u32 num_slots = map.num_slots;
+  u32 num_free = 0;
+  u32 index = (u32)map.free_head.load();
+  while (index != CONCURRENT_SLOTMAP_NONE && num_free <= num_slots) {
+    auto node = NodeAt(&map, index);
+    CHECK(node && node->generation % 2 == 0);
+    num_free++;
+    index = node->next_free;
+  }
+  CHECK(num_free == num_slots);
+
+  Free(&map);
+  return 0;
+}
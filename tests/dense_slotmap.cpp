@@ -0,0 +1,121 @@
+// DenseSlotMap: swap-remove keeps every key pointing at its value
+#include <core.h>
+#include <unordered_map>
+#include "check.h"
+
+using namespace core;
+
+MAKE_SLOTMAP_KEY(Entity);
+
+static
+u64 ToRaw(Entity id) {
+  return (u64)id.index << 32 | id.generation;
+}
+
+static
+u64 NextRandom(u64* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// Every live key resolves to its value, the values are packed at the
+// front, and iteration visits each exactly once
+static
+void CheckMap(DenseSlotMap<Entity, u32>* sm, std::unordered_map<u64, u32>& live) {
+  CHECK(sm->length == live.size());
+  for (auto [raw, value] : live) {
+    Entity id = { .index = (u32)(raw >> 32), .generation = (u32)raw };
+    auto found = Get(sm, id);
+    CHECK(found && *found == value);
+    CHECK(found >= sm->values && found < sm->values + sm->length);
+  }
+  usize num_visited = 0;
+  auto iter = Iter(sm);
+  while (auto entry = Next(&iter)) {
+    auto it = live.find(ToRaw(entry.key));
+    CHECK(it != live.end());
+    CHECK(*entry.value == it->second);
+    num_visited++;
+  }
+  CHECK(num_visited == live.size());
+}
+
+static
+void TestSwapRemove() {
+  DenseSlotMap<Entity, u32> sm{};
+  auto a = Insert(&sm, 1u);
+  auto b = Insert(&sm, 2u);
+  auto c = Insert(&sm, 3u);
+
+  // The last value moves into a's place, and c's slot follows it
+  CHECK(Remove(&sm, a));
+  CHECK(sm.length == 2);
+  CHECK(sm.values[0] == 3);
+  CHECK(Get(&sm, c) == &sm.values[0]);
+  CHECK(*Get(&sm, b) == 2);
+
+  // Removed and stale keys miss, and cannot be removed again
+  CHECK(!Get(&sm, a));
+  CHECK(!Contains(&sm, a));
+  CHECK(!Remove(&sm, a));
+
+  // The freed slot is reused with a new generation
+  auto d = Insert(&sm, 4u);
+  CHECK(d.index == a.index);
+  CHECK(d.generation == a.generation + 2);
+  CHECK(!Get(&sm, a));
+  CHECK(*Get(&sm, d) == 4);
+
+  // Removing the last value moves nothing
+  CHECK(Remove(&sm, d));
+  CHECK(*Get(&sm, c) == 3);
+  CHECK(*Get(&sm, b) == 2);
+  Free(&sm);
+}
+
+static
+void TestChurn() {
+  DenseSlotMap<Entity, u32> sm{};
+  std::unordered_map<u64, u32> live;
+  Entity keys[1000];
+  Entity removed[1000];
+  usize num_keys = 0;
+  usize num_removed = 0;
+  u64 rng = 11;
+  for (u32 op = 0; op < 20000; ++op) {
+    // Drift between mostly full and mostly empty
+    bool insert = num_keys == 0 || (num_keys < 1000 && NextRandom(&rng) % 100 < ((op / 2000) % 2 ? 30 : 70));
+    if (insert) {
+      auto id = Insert(&sm, op);
+      CHECK(id.generation % 2 == 1);
+      CHECK(live.count(ToRaw(id)) == 0);
+      live[ToRaw(id)] = op;
+      keys[num_keys++] = id;
+    } else {
+      usize i = NextRandom(&rng) % num_keys;
+      CHECK(Remove(&sm, keys[i]));
+      live.erase(ToRaw(keys[i]));
+      removed[num_removed++ % 1000] = keys[i];
+      keys[i] = keys[--num_keys];
+    }
+    // Keys removed earlier stay dead, even once their slot is reused
+    if (num_removed > 0) {
+      auto stale = removed[NextRandom(&rng) % Min<usize>(num_removed, 1000)];
+      CHECK(!Get(&sm, stale));
+      CHECK(!Remove(&sm, stale));
+    }
+    if (op % 97 == 0) {
+      CheckMap(&sm, live);
+    }
+  }
+  CheckMap(&sm, live);
+  Free(&sm);
+}
+
+int main() {
+  TestSwapRemove();
+  TestChurn();
+  return 0;
+}
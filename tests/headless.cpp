@@ -0,0 +1,99 @@
+// Runs the ui without a rendering backend, measuring text with the
+// monospace stub
+#include <core.h>
+#include <ui.h>
+#include "check.h"
+
+using namespace core;
+
+static
+void BuildUi(ui::Ui* ui, bool* clicked, ui::WidgetId* button_id) {
+  ui::Window(ui, LIT("Window"));
+  ui::Header(ui, LIT("Header"));
+  ui::HList(ui);
+  // Scoped by the window's id
+  *button_id = ui::MakeId(ui, LIT("Button"));
+  *clicked = ui::Button(ui, LIT("Button"));
+  ui::Label(ui, LIT("Label"));
+  ui::PopParent(ui);
+  ui::PopParent(ui);
+}
+
+// More windows than the context was sized for, all in the first frame:
+// the widget cache has to grow mid-frame
+static
+void TestManyWindows() {
+  auto ctx = ui::NewCtx(16);
+  Arena frame_arena = NewArena(64 * 1024);
+  const u64 NUM_WINDOWS = 2100;
+  for (int frame = 0; frame < 2; ++frame) {
+    auto ui = ui::BeginUi(&ctx, &frame_arena, { 0.0, 0.0, 800.0, 600.0 });
+    for (u64 i = 0; i < NUM_WINDOWS; ++i) {
+      ui::PushId(ui, i);
+      ui::Window(ui, LIT("Window"));
+      ui::PopParent(ui);
+      ui::PopId(ui);
+    }
+    ui::EndUi(ui);
+    CHECK(ctx.write_cache.len == NUM_WINDOWS);
+    Reset(&frame_arena);
+  }
+  Free(&frame_arena);
+  ui::Destroy(&ctx);
+}
+
+int main() {
+  auto ctx = ui::NewCtx(16);
+  Arena frame_arena = NewArena(64 * 1024);
+  ui::Rect screen = { 0.0, 0.0, 800.0, 600.0 };
+
+  // Frame 0: lay out and find the button
+  bool clicked = false;
+  ui::WidgetId button_id = ui::NO_ID;
+  auto ui = ui::BeginUi(&ctx, &frame_arena, screen);
+  BuildUi(ui, &clicked, &button_id);
+  ui::EndUi(ui);
+  CHECK(ui->changed);
+  CHECK(ui->draw_list->len > 0);
+
+  ui::Rect button_bounds = {};
+  for (u32 i = 0; i < ui::NumWidgets(ui); ++i) {
+    if (ui::BehaviorOf(ui, { i })->id.id == button_id.id) {
+      button_bounds = ui::LayoutOf(ui, { i })->bounds;
+    }
+  }
+  CHECK(button_bounds.w > 0 && button_bounds.h > 0);
+  Reset(&frame_arena);
+
+  // Frame 1: nothing changed, so nothing to draw
+  ui = ui::BeginUi(&ctx, &frame_arena, screen);
+  BuildUi(ui, &clicked, &button_id);
+  ui::EndUi(ui);
+  CHECK(!ui->changed);
+  Reset(&frame_arena);
+
+  // Frames 2 and 3: press on the button, which reacts a frame later
+  ctx.mouse = {
+    .pos = { button_bounds.x + 1, button_bounds.y + 1 },
+    .pressed = true,
+    .down = true,
+  };
+  ui = ui::BeginUi(&ctx, &frame_arena, screen);
+  BuildUi(ui, &clicked, &button_id);
+  ui::EndUi(ui);
+  CHECK(ctx.input.hovered_id.id == button_id.id);
+  CHECK(ctx.needs_frame);
+  Reset(&frame_arena);
+
+  ui = ui::BeginUi(&ctx, &frame_arena, screen);
+  BuildUi(ui, &clicked, &button_id);
+  ui::EndUi(ui);
+  CHECK(clicked);
+  Reset(&frame_arena);
+
+  Free(&frame_arena);
+  ui::Destroy(&ctx);
+
+  TestManyWindows();
+  return 0;
+}
@@ -0,0 +1,228 @@
+// Slotmaps: iteration over the occupancy bitmap, and bounded capacity
+#include <core.h>
+#include <unordered_map>
+#include "check.h"
+
+using namespace core;
+
+MAKE_SLOTMAP_KEY(Entity);
+
+static
+u64 ToRaw(Entity id) {
+  return (u64)id.index << 32 | id.generation;
+}
+
+static
+u64 NextRandom(u64* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// Range-for visits exactly the live values, in index order
+static
+void CheckIteration(SlotMap<Entity, u32>* sm, std::unordered_map<u64, u32>& live) {
+  usize num_visited = 0;
+  i64 last_index = -1;
+  for (auto entry : sm) {
+    CHECK((i64)entry.key.index > last_index);
+    last_index = entry.key.index;
+    auto it = live.find(ToRaw(entry.key));
+    CHECK(it != live.end());
+    CHECK(*entry.value == it->second);
+    CHECK(Get(sm, entry.key) == entry.value);
+    num_visited++;
+  }
+  CHECK(num_visited == live.size());
+}
+
+static
+void TestIterationAtWordBoundaries() {
+  SlotMap<Entity, u32> sm{};
+  // Not a multiple of 64, so the last bitmap word is partial
+  Reserve(&sm, 130);
+  CHECK(sm.capacity == 130);
+  Entity keys[130];
+  for (u32 i = 0; i < 130; ++i) {
+    keys[i] = Insert(&sm, i);
+  }
+  CHECK(sm.capacity == 130);
+
+  std::unordered_map<u64, u32> live;
+  // Either side of each word boundary, and the last index
+  bool kept[130] = {};
+  for (u32 i : { 0, 63, 64, 127, 128, 129 }) {
+    kept[i] = true;
+    live[ToRaw(keys[i])] = i;
+  }
+  for (u32 i = 0; i < 130; ++i) {
+    if (!kept[i]) {
+      CHECK(Remove(&sm, keys[i]));
+    }
+  }
+  CheckIteration(&sm, live);
+
+  // Emptying a word at the start, in the middle, and at the end
+  for (u32 i : { 0, 63, 129 }) {
+    CHECK(Remove(&sm, keys[i]));
+    live.erase(ToRaw(keys[i]));
+    CheckIteration(&sm, live);
+  }
+  CHECK(Remove(&sm, keys[64]));
+  CHECK(Remove(&sm, keys[127]));
+  CHECK(Remove(&sm, keys[128]));
+  live.clear();
+  CheckIteration(&sm, live);
+  Free(&sm);
+}
+
+static
+void TestIterationUnderChurn() {
+  SlotMap<Entity, u32> sm{};
+  std::unordered_map<u64, u32> live;
+  Entity keys[1000];
+  usize num_keys = 0;
+  u64 rng = 7;
+  for (u32 op = 0; op < 20000; ++op) {
+    // Drift between mostly full and mostly empty
+    bool insert = num_keys == 0 || (num_keys < 1000 && NextRandom(&rng) % 100 < ((op / 2000) % 2 ? 30 : 70));
+    if (insert) {
+      auto id = Insert(&sm, op);
+      CHECK(live.count(ToRaw(id)) == 0);
+      live[ToRaw(id)] = op;
+      keys[num_keys++] = id;
+    } else {
+      usize i = NextRandom(&rng) % num_keys;
+      CHECK(Remove(&sm, keys[i]));
+      CHECK(!Remove(&sm, keys[i]));
+      live.erase(ToRaw(keys[i]));
+      keys[i] = keys[--num_keys];
+    }
+    if (op % 97 == 0) {
+      CheckIteration(&sm, live);
+    }
+  }
+  CheckIteration(&sm, live);
+  Free(&sm);
+}
+
+// InsertMany takes free nodes first, then fresh ones; RemoveMany
+// frees them all, on a heap-backed map
+static
+void TestInsertManyAndRemoveMany() {
+  SlotMap<Entity, u32> sm{};
+  Arena arena = NewArena(4096);
+  auto keys = NewGrowableArray<Entity>(&arena);
+  u32 values[300];
+  for (u32 i = 0; i < 300; ++i) {
+    values[i] = i;
+  }
+  CHECK(InsertMany(&sm, values, 100, keys) == 100);
+  // Free every other node, so the next batch mixes both kinds
+  auto freed = NewGrowableArray<Entity>(&arena);
+  for (usize i = 0; i < 100; i += 2) {
+    Push(freed, keys->buffer[i]);
+  }
+  CHECK(RemoveMany(&sm, freed) == 50);
+  CHECK(RemoveMany(&sm, freed) == 0);
+  CHECK(sm.num_free == 50);
+
+  std::unordered_map<u64, u32> live;
+  for (usize i = 1; i < 100; i += 2) {
+    live[ToRaw(keys->buffer[i])] = values[i];
+  }
+  Clear(keys);
+  CHECK(InsertMany(&sm, values + 100, 200, keys) == 200);
+  CHECK(keys->len == 200);
+  CHECK(sm.num_free == 0);
+  CHECK(sm.length == 250);
+  for (usize i = 0; i < 200; ++i) {
+    auto id = keys->buffer[i];
+    // The first 50 reuse freed nodes, with a new generation
+    CHECK((id.generation == 1) == (i >= 50));
+    CHECK(live.count(ToRaw(id)) == 0);
+    live[ToRaw(id)] = values[100 + i];
+    CHECK(*Get(&sm, id) == values[100 + i]);
+  }
+  CheckIteration(&sm, live);
+  for (auto freed_id : freed) {
+    CHECK(!Get(&sm, freed_id));
+  }
+
+  // Removing everything through RemoveMany
+  Clear(keys);
+  for (auto entry : &sm) {
+    Push(keys, entry.key);
+  }
+  CHECK(RemoveMany(&sm, keys) == 250);
+  CHECK(sm.num_free == 250);
+  live.clear();
+  CheckIteration(&sm, live);
+
+  Free(&arena);
+  Free(&sm);
+}
+
+static
+void TestVirtualSlotMapFills() {
+  const usize MAX_CAPACITY = 500000;
+  auto sm = NewVirtualSlotMap<Entity, u32>(MAX_CAPACITY);
+  auto first = Insert(&sm, 0u);
+  auto nodes = sm.nodes;
+  for (u32 i = 1; i < MAX_CAPACITY; ++i) {
+    auto id = Insert(&sm, i);
+    CHECK(id.generation == 1);
+  }
+  // Growth stopped at the reserved range, in place
+  CHECK(sm.capacity == MAX_CAPACITY);
+  CHECK(sm.nodes == nodes);
+
+  // Full: inserts fail cleanly, and the failed key is never live
+  auto id = Insert(&sm, 1234u);
+  CHECK(id.generation == 0);
+  CHECK(!Get(&sm, id));
+
+  Arena arena = NewArena(4096);
+  auto keys = NewGrowableArray<Entity>(&arena);
+  u32 values[] = { 1, 2, 3 };
+  CHECK(InsertMany(&sm, values, 3, keys) == 0);
+  CHECK(keys->len == 0);
+
+  // Freed nodes are reused up to the limit
+  CHECK(Remove(&sm, first));
+  CHECK(InsertMany(&sm, values, 3, keys) == 1);
+  CHECK(keys->len == 1);
+  CHECK(*Get(&sm, keys->buffer[0]) == 1);
+
+  Free(&arena);
+  Free(&sm);
+}
+
+static
+void TestInsertManyStopsAtCapacity() {
+  auto sm = NewVirtualSlotMap<Entity, u32>(1000);
+  Arena arena = NewArena(4096);
+  auto values = NewFullArray<u32>(&arena, 600);
+  for (u32 i = 0; i < 600; ++i) {
+    values->buffer[i] = i;
+  }
+  auto keys = NewGrowableArray<Entity>(&arena);
+  CHECK(InsertMany(&sm, values, keys) == 600);
+  CHECK(InsertMany(&sm, values, keys) == 400);
+  CHECK(keys->len == 1000);
+  CHECK(sm.length == 1000);
+  CHECK(Insert(&sm, 0u).generation == 0);
+
+  Free(&arena);
+  Free(&sm);
+}
+
+int main() {
+  TestIterationAtWordBoundaries();
+  TestIterationUnderChurn();
+  TestInsertManyAndRemoveMany();
+  TestVirtualSlotMapFills();
+  TestInsertManyStopsAtCapacity();
+  return 0;
+}